@@ -15,26 +15,104 @@ typedef int8_t i8;
 typedef double f64;
 typedef float f32;
 
+// Minimal perfect hash over the asset names, CHD style. Keys are hashed
+// into bucketCount buckets, and each bucket stores one displacement in the
+// i32 array that directly follows this header in the pack:
+//   < 0: the bucket holds a single key, which lives in slot -d - 1.
+//   >= 0: every key in the bucket lives in slot mixHash(g ^ seed(d)) % n.
+// The table of contents follows the displacements, indexed by slot.
 struct Hash {
-	u32 prime;
-	u32 startChars;
-	u32 endChars;
-	size_t assetCount;
+	u64 seed;
+	u32 bucketCount;
+	u32 reserved;
+	u64 assetCount;
 };
 
-#define HASH_SIZE sizeof(Hash)
+// Every field in the pack is fixed width and little endian, and every blob
+// starts at a multiple of the header's alignment (a page by default), so the
+// pack can be mapped and its blobs used in place.
+#define PACK_MAGIC 0x4b564c50 // "PLVK"
+#define PACK_VERSION 1
+#define DEFAULT_PACK_ALIGNMENT 4096
+
+struct PackHeader {
+	u32 magic;
+	u32 version;
+	u32 alignment;
+	u32 reserved;
+	Hash hash;
+};
 
-enum AssetType {
+#define PACK_HEADER_SIZE sizeof(PackHeader)
+// Padded to 8 bytes so the table of contents that follows stays aligned
+#define DISPLACEMENTS_SIZE(hash) ((sizeof(i32) * (hash).bucketCount + 7) & ~7ull)
+
+// splitmix64 finalizer
+constexpr u64 mixHash(u64 x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+// FNV-1a over an asset's basename. This is the asset's ID, both in the table
+// of contents and in the engine.
+constexpr u64 hashAssetName(const char *name) {
+	u64 hash = 0xcbf29ce484222325ull;
+	for (const char *c = name; *c != '\0'; c++) {
+		hash ^= (u8)*c;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+constexpr u64 perfectHashBucketKey(const Hash &hash, u64 id) {
+	return mixHash(id ^ hash.seed);
+}
+
+constexpr u64 perfectHashSlot(const Hash &hash, u64 bucketKey,
+							  i32 displacement) {
+	if (displacement < 0) {
+		return (u64)(-(i64)displacement - 1);
+	}
+	return mixHash(bucketKey ^ (0x9e3779b97f4a7c15ull * (u64)displacement)) %
+		   hash.assetCount;
+}
+
+// Slot of an asset in the table of contents. The entry there still has to be
+// checked against the ID, since unknown IDs land on some slot too.
+constexpr u64 perfectHashLookup(const Hash &hash, const i32 *displacements,
+								u64 id) {
+	u64 key = perfectHashBucketKey(hash, id);
+	return perfectHashSlot(hash, key, displacements[key % hash.bucketCount]);
+}
+
+enum AssetType : u32 {
 	IMAGE,
 	MODEL,
 	VOXEL_MODEL,
 };
 
+enum EntryFlags {
+	// Everything after the asset's metadata is a sequence of LZ4 blocks, each
+	// prefixed by its compressed size as a u32. Blocks decode to
+	// COMPRESSED_BLOCK_SIZE bytes (the last one may be shorter) and may
+	// reference earlier output, so they must be decoded in order into one
+	// contiguous buffer.
+	ENTRY_COMPRESSED = 1,
+};
+
+#define COMPRESSED_BLOCK_SIZE (64 * 1024)
+
 struct Entry {
 	u64 hash;
-	uintptr_t offset;
-	uintptr_t size;
+	u64 offset;
+	u64 size;	 // Bytes in the pack
+	u64 rawSize; // Bytes once decompressed
 	AssetType type;
+	u32 flags;
 
 	bool operator<(const Entry &comp) const { return (hash < comp.hash); }
 
@@ -43,10 +121,31 @@ struct Entry {
 
 #define ENTRY_SIZE sizeof(Entry)
 
+static_assert(sizeof(PackHeader) == 40 && sizeof(Entry) == 40,
+			  "pack structures must not depend on the platform");
+
+#define MAX_MIP_LEVELS 16
+
+// How the texels of a texture are stored. Block formats store 4x4 texel
+// blocks row by row, padding levels smaller than a block to a whole block.
+enum TextureFormat : u32 {
+	TEXTURE_RGBA8,
+	TEXTURE_BC1, // Opaque RGB, 8 bytes per block
+	TEXTURE_BC3, // RGBA with separate alpha, 16 bytes per block
+	TEXTURE_BC5, // Two channels (normal map xy), 16 bytes per block
+	TEXTURE_BC7, // RGBA, 16 bytes per block
+};
+
 struct TextureMetadata {
-	int width;
-	int height;
-	int bitDepth;
+	i32 width;
+	i32 height;
+	i32 bitDepth; // Bytes per texel of the RGBA8 source
+	TextureFormat format;
+	u32 mipLevels;
+	u32 reserved;
+	// Byte offset of each level from the start of the pixel data. Level i is
+	// max(1, width >> i) by max(1, height >> i) texels.
+	u64 mipOffsets[MAX_MIP_LEVELS];
 };
 
 enum VertexAttrib {
@@ -59,7 +158,21 @@ enum VertexAttrib {
 struct ModelMetadata {
 	u64 vertexCount;
 	u64 indexCount;
+	// Positions are quantized inside the model's bounding cube:
+	// pos = positionOffset + (quantized / 65535) * positionScale
+	f32 positionOffset[3];
+	f32 positionScale;
 	u8 vertexAttributes;
+	u8 indexSize; // 2 or 4 bytes
+	u8 reserved[6];
+};
+
+// Vertex layout of packed models, 20 bytes.
+struct PackedVertex {
+	u16 pos[4];		// unorm16 in the bounding cube, w unused
+	i16 normal[2];	// Octahedral snorm16
+	i16 tangent[2]; // Octahedral snorm16
+	u16 texCoord[2]; // Half floats
 };
 
 struct VoxelModelMetadata {
@@ -72,5 +185,12 @@ struct VoxelModelMetadata {
 
 struct Voxel {
 	uint8_t pos[3];
+	// Material table index plus one for blocks, 0 for plain colored voxels
+	uint8_t block;
 	uint32_t color;
 };
+
+static_assert(sizeof(TextureMetadata) == 152 && sizeof(ModelMetadata) == 40 &&
+				  sizeof(PackedVertex) == 20 &&
+				  sizeof(VoxelModelMetadata) == 16 && sizeof(Voxel) == 8,
+			  "asset metadata must not depend on the platform");
@@ -0,0 +1,456 @@
+#include "bc_encoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+const u32 BLOCK_DIM = 4;
+const u32 BLOCK_TEXELS = BLOCK_DIM * BLOCK_DIM;
+
+// NOTE: Small levels aren't worth starting threads for
+const u32 MIN_BLOCKS_PER_THREAD = 1024;
+
+struct Block {
+	u8 texels[BLOCK_TEXELS][4];
+};
+
+// Texels past the edge of the image repeat the last row or column.
+static void loadBlock(const u8 *pixels, u32 width, u32 height, u32 blockX,
+					  u32 blockY, Block &block) {
+	for (u32 y = 0; y < BLOCK_DIM; y++) {
+		u32 sourceY = std::min(blockY * BLOCK_DIM + y, height - 1);
+		for (u32 x = 0; x < BLOCK_DIM; x++) {
+			u32 sourceX = std::min(blockX * BLOCK_DIM + x, width - 1);
+			memcpy(block.texels[y * BLOCK_DIM + x],
+				   pixels + ((size_t)sourceY * width + sourceX) * 4, 4);
+		}
+	}
+}
+
+// Mean and dominant axis of the first `channels` channels of a block, found by
+// power iteration on their covariance.
+static void principalAxis(const Block &block, u32 channels, f32 mean[4],
+						  f32 axis[4]) {
+	for (u32 c = 0; c < channels; c++) {
+		mean[c] = 0.0f;
+		for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+			mean[c] += block.texels[i][c];
+		}
+		mean[c] /= BLOCK_TEXELS;
+	}
+
+	f32 covariance[4][4] = {};
+	for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+		for (u32 a = 0; a < channels; a++) {
+			for (u32 b = 0; b < channels; b++) {
+				covariance[a][b] += (block.texels[i][a] - mean[a]) *
+									(block.texels[i][b] - mean[b]);
+			}
+		}
+	}
+
+	for (u32 c = 0; c < channels; c++) {
+		axis[c] = 1.0f;
+	}
+	for (u32 iteration = 0; iteration < 8; iteration++) {
+		f32 next[4] = {};
+		f32 largest = 0.0f;
+		for (u32 a = 0; a < channels; a++) {
+			for (u32 b = 0; b < channels; b++) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			largest = std::max(largest, std::abs(next[a]));
+		}
+		if (largest == 0.0f) {
+			break;
+		}
+		for (u32 c = 0; c < channels; c++) {
+			axis[c] = next[c] / largest;
+		}
+	}
+}
+
+// Endpoints at the extremes of the block's projection onto its axis.
+static void axisEndpoints(const Block &block, u32 channels, f32 low[4],
+						  f32 high[4]) {
+	f32 mean[4];
+	f32 axis[4];
+	principalAxis(block, channels, mean, axis);
+
+	f32 lengthSquared = 0.0f;
+	for (u32 c = 0; c < channels; c++) {
+		lengthSquared += axis[c] * axis[c];
+	}
+
+	f32 minimum = 0.0f;
+	f32 maximum = 0.0f;
+	for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+		f32 t = 0.0f;
+		for (u32 c = 0; c < channels; c++) {
+			t += (block.texels[i][c] - mean[c]) * axis[c];
+		}
+		t /= lengthSquared;
+		minimum = std::min(minimum, t);
+		maximum = std::max(maximum, t);
+	}
+	for (u32 c = 0; c < channels; c++) {
+		low[c] = std::clamp(mean[c] + minimum * axis[c], 0.0f, 255.0f);
+		high[c] = std::clamp(mean[c] + maximum * axis[c], 0.0f, 255.0f);
+	}
+}
+
+static void writeU16(u8 *out, u16 value) {
+	out[0] = value & 0xff;
+	out[1] = value >> 8;
+}
+
+// BC1
+
+static u16 packRgb565(const f32 colour[3]) {
+	u32 r = (u32)std::clamp(std::lround(colour[0] * 31.0f / 255.0f), 0l, 31l);
+	u32 g = (u32)std::clamp(std::lround(colour[1] * 63.0f / 255.0f), 0l, 63l);
+	u32 b = (u32)std::clamp(std::lround(colour[2] * 31.0f / 255.0f), 0l, 31l);
+	return (r << 11) | (g << 5) | b;
+}
+
+static void unpackRgb565(u16 packed, i32 colour[3]) {
+	i32 r = (packed >> 11) & 31;
+	i32 g = (packed >> 5) & 63;
+	i32 b = packed & 31;
+	colour[0] = (r << 3) | (r >> 2);
+	colour[1] = (g << 2) | (g >> 4);
+	colour[2] = (b << 3) | (b >> 2);
+}
+
+// Picks the nearest of the four palette colours for every texel. Returns the
+// squared error.
+static u32 bc1Indices(const Block &block, u16 colour0, u16 colour1,
+					  u8 indices[BLOCK_TEXELS]) {
+	i32 palette[4][3];
+	unpackRgb565(colour0, palette[0]);
+	unpackRgb565(colour1, palette[1]);
+	for (u32 c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	u32 error = 0;
+	for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+		u32 bestError = UINT32_MAX;
+		for (u32 p = 0; p < 4; p++) {
+			u32 e = 0;
+			for (u32 c = 0; c < 3; c++) {
+				i32 d = block.texels[i][c] - palette[p][c];
+				e += d * d;
+			}
+			if (e < bestError) {
+				bestError = e;
+				indices[i] = p;
+			}
+		}
+		error += bestError;
+	}
+	return error;
+}
+
+// Orders the endpoints for four colour mode and scores them.
+static u32 bc1Candidate(const Block &block, u16 &colour0, u16 &colour1,
+						u8 indices[BLOCK_TEXELS]) {
+	if (colour0 < colour1) {
+		std::swap(colour0, colour1);
+	}
+	return bc1Indices(block, colour0, colour1, indices);
+}
+
+static void encodeBC1(const Block &block, u8 out[8]) {
+	f32 low[4];
+	f32 high[4];
+	axisEndpoints(block, 3, low, high);
+
+	// NOTE: Pull the endpoints in slightly so the interpolated colours land
+	// closer to where the texels actually are.
+	for (u32 c = 0; c < 3; c++) {
+		f32 inset = (high[c] - low[c]) / 16.0f;
+		low[c] += inset;
+		high[c] -= inset;
+	}
+
+	u16 colour0 = packRgb565(high);
+	u16 colour1 = packRgb565(low);
+	u8 indices[BLOCK_TEXELS];
+	u32 error = bc1Candidate(block, colour0, colour1, indices);
+
+	// One least squares pass: refit both endpoints to the chosen indices
+	if (colour0 != colour1) {
+		const f32 weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+		f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		f32 ax[3] = {}, bx[3] = {};
+		for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+			f32 w = weights[indices[i]];
+			aa += w * w;
+			ab += w * (1.0f - w);
+			bb += (1.0f - w) * (1.0f - w);
+			for (u32 c = 0; c < 3; c++) {
+				ax[c] += w * block.texels[i][c];
+				bx[c] += (1.0f - w) * block.texels[i][c];
+			}
+		}
+
+		f32 determinant = aa * bb - ab * ab;
+		if (std::abs(determinant) > 1e-6f) {
+			f32 refined0[3];
+			f32 refined1[3];
+			for (u32 c = 0; c < 3; c++) {
+				refined0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+				refined1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+			}
+			u16 refinedColour0 = packRgb565(refined0);
+			u16 refinedColour1 = packRgb565(refined1);
+			u8 refinedIndices[BLOCK_TEXELS];
+			u32 refinedError = bc1Candidate(block, refinedColour0,
+											refinedColour1, refinedIndices);
+			if (refinedError < error && refinedColour0 != refinedColour1) {
+				colour0 = refinedColour0;
+				colour1 = refinedColour1;
+				memcpy(indices, refinedIndices, BLOCK_TEXELS);
+			}
+		}
+	}
+
+	// NOTE: Equal endpoints switch the block to three colour mode, where
+	// index 0 is still colour0, so a flat block just uses index 0.
+	u32 packedIndices = 0;
+	if (colour0 != colour1) {
+		for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+			packedIndices |= (u32)indices[i] << (2 * i);
+		}
+	}
+	writeU16(out, colour0);
+	writeU16(out + 2, colour1);
+	for (u32 i = 0; i < 4; i++) {
+		out[4 + i] = (packedIndices >> (8 * i)) & 0xff;
+	}
+}
+
+// BC4, one channel of a block
+
+static void encodeBC4(const Block &block, u32 channel, u8 out[8]) {
+	u8 minimum = 255;
+	u8 maximum = 0;
+	for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+		minimum = std::min(minimum, block.texels[i][channel]);
+		maximum = std::max(maximum, block.texels[i][channel]);
+	}
+
+	out[0] = maximum;
+	out[1] = minimum;
+	u64 packedIndices = 0;
+	if (maximum != minimum) {
+		// Eight value mode, since endpoint 0 > endpoint 1
+		i32 palette[8];
+		palette[0] = maximum;
+		palette[1] = minimum;
+		for (i32 p = 2; p < 8; p++) {
+			palette[p] = ((8 - p) * maximum + (p - 1) * minimum + 3) / 7;
+		}
+
+		for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+			i32 value = block.texels[i][channel];
+			u32 best = 0;
+			for (u32 p = 1; p < 8; p++) {
+				if (std::abs(value - palette[p]) <
+					std::abs(value - palette[best])) {
+					best = p;
+				}
+			}
+			packedIndices |= (u64)best << (3 * i);
+		}
+	}
+	for (u32 i = 0; i < 6; i++) {
+		out[2 + i] = (packedIndices >> (8 * i)) & 0xff;
+	}
+}
+
+// BC7, mode 6 only: one subset, RGBA 7.7.7.7 endpoints with a p-bit each and
+// 4 bit indices. It handles alpha well and is far simpler than a full search
+// over all eight modes.
+
+const u32 BC7_WEIGHTS[16] = {0,	 4,	 9,	 13, 17, 21, 26, 30,
+							 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct BitWriter {
+	u8 *out;
+	u32 position;
+
+	void write(u32 value, u32 bits) {
+		for (u32 i = 0; i < bits; i++, position++) {
+			if ((value >> i) & 1) {
+				out[position / 8] |= 1 << (position % 8);
+			}
+		}
+	}
+};
+
+// Quantizes an endpoint to 7 bits per channel plus a shared p-bit, picking
+// the p-bit with the lower error.
+static void quantizeBC7Endpoint(const f32 endpoint[4], u32 quantized[4],
+								u32 &pBit) {
+	f32 bestError = INFINITY;
+	for (u32 p = 0; p < 2; p++) {
+		u32 candidate[4];
+		f32 error = 0.0f;
+		for (u32 c = 0; c < 4; c++) {
+			candidate[c] = (u32)std::clamp(
+				std::lround((endpoint[c] - p) / 2.0f), 0l, 127l);
+			f32 d = (f32)((candidate[c] << 1) | p) - endpoint[c];
+			error += d * d;
+		}
+		if (error < bestError) {
+			bestError = error;
+			pBit = p;
+			memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+static void encodeBC7(const Block &block, u8 out[16]) {
+	f32 low[4];
+	f32 high[4];
+	axisEndpoints(block, 4, low, high);
+
+	u32 quantized[2][4];
+	u32 pBits[2];
+	quantizeBC7Endpoint(low, quantized[0], pBits[0]);
+	quantizeBC7Endpoint(high, quantized[1], pBits[1]);
+
+	i32 palette[16][4];
+	for (u32 p = 0; p < 16; p++) {
+		for (u32 c = 0; c < 4; c++) {
+			i32 e0 = (quantized[0][c] << 1) | pBits[0];
+			i32 e1 = (quantized[1][c] << 1) | pBits[1];
+			palette[p][c] =
+				((64 - BC7_WEIGHTS[p]) * e0 + BC7_WEIGHTS[p] * e1 + 32) >> 6;
+		}
+	}
+
+	u32 indices[BLOCK_TEXELS];
+	for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+		u32 bestError = UINT32_MAX;
+		for (u32 p = 0; p < 16; p++) {
+			u32 error = 0;
+			for (u32 c = 0; c < 4; c++) {
+				i32 d = block.texels[i][c] - palette[p][c];
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				indices[i] = p;
+			}
+		}
+	}
+
+	// The first index is stored without its top bit, so it must be < 8
+	if (indices[0] >= 8) {
+		std::swap(quantized[0], quantized[1]);
+		std::swap(pBits[0], pBits[1]);
+		for (u32 i = 0; i < BLOCK_TEXELS; i++) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(out, 0, 16);
+	BitWriter writer{out, 0};
+	writer.write(1 << 6, 7); // Mode 6
+	for (u32 c = 0; c < 4; c++) {
+		writer.write(quantized[0][c], 7);
+		writer.write(quantized[1][c], 7);
+	}
+	writer.write(pBits[0], 1);
+	writer.write(pBits[1], 1);
+	writer.write(indices[0], 3);
+	for (u32 i = 1; i < BLOCK_TEXELS; i++) {
+		writer.write(indices[i], 4);
+	}
+}
+
+static size_t blockBytes(TextureFormat format) {
+	return format == TEXTURE_BC1 ? 8 : 16;
+}
+
+static void encodeBlock(TextureFormat format, const Block &block, u8 *out) {
+	switch (format) {
+	case TEXTURE_BC1:
+		encodeBC1(block, out);
+		break;
+	case TEXTURE_BC3:
+		encodeBC4(block, 3, out);
+		encodeBC1(block, out + 8);
+		break;
+	case TEXTURE_BC5:
+		encodeBC4(block, 0, out);
+		encodeBC4(block, 1, out + 8);
+		break;
+	case TEXTURE_BC7:
+		encodeBC7(block, out);
+		break;
+	case TEXTURE_RGBA8:
+		break;
+	}
+}
+
+TextureFormat chooseBlockFormat(const u8 *pixels, size_t texelCount,
+								bool normalMap) {
+	bool opaque = true;
+	for (size_t i = 0; i < texelCount && opaque; i++) {
+		opaque = pixels[4 * i + 3] == 255;
+	}
+
+	if (normalMap) {
+		return opaque ? TEXTURE_BC5 : TEXTURE_BC3;
+	}
+	return opaque ? TEXTURE_BC1 : TEXTURE_BC7;
+}
+
+size_t compressedLevelSize(TextureFormat format, u32 width, u32 height) {
+	size_t blocksX = (width + BLOCK_DIM - 1) / BLOCK_DIM;
+	size_t blocksY = (height + BLOCK_DIM - 1) / BLOCK_DIM;
+	return blocksX * blocksY * blockBytes(format);
+}
+
+void compressLevel(TextureFormat format, const u8 *pixels, u32 width,
+				   u32 height, u8 *out, u32 threads) {
+	u32 blocksX = (width + BLOCK_DIM - 1) / BLOCK_DIM;
+	u32 blocksY = (height + BLOCK_DIM - 1) / BLOCK_DIM;
+	size_t bytes = blockBytes(format);
+
+	auto encodeRows = [&](u32 firstRow, u32 lastRow) {
+		Block block;
+		for (u32 y = firstRow; y < lastRow; y++) {
+			for (u32 x = 0; x < blocksX; x++) {
+				loadBlock(pixels, width, height, x, y, block);
+				encodeBlock(format, block,
+							out + ((size_t)y * blocksX + x) * bytes);
+			}
+		}
+	};
+
+	u32 maxThreads =
+		std::max<u32>(1, (blocksX * blocksY) / MIN_BLOCKS_PER_THREAD);
+	threads = std::clamp<u32>(threads, 1, std::min(maxThreads, blocksY));
+	if (threads == 1) {
+		encodeRows(0, blocksY);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	u32 rowsPerThread = (blocksY + threads - 1) / threads;
+	for (u32 first = 0; first < blocksY; first += rowsPerThread) {
+		workers.emplace_back(encodeRows, first,
+							 std::min(first + rowsPerThread, blocksY));
+	}
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
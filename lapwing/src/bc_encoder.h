@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+#include "lapwing.h"
+
+// Picks a block format for an RGBA8 image: BC5 for normal maps, BC3 for
+// normal maps whose alpha is used, BC1 for opaque colour and BC7 otherwise.
+TextureFormat chooseBlockFormat(const u8 *pixels, size_t texelCount,
+								bool normalMap);
+
+size_t compressedLevelSize(TextureFormat format, u32 width, u32 height);
+
+// Encodes one RGBA8 level into `out`, splitting the rows of blocks over
+// `threads` threads. The result does not depend on the thread count.
+void compressLevel(TextureFormat format, const u8 *pixels, u32 width,
+				   u32 height, u8 *out, u32 threads);
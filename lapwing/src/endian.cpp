@@ -1,5 +1,7 @@
 #include "endian.h"
 
+#include <cstring>
+
 #if _WIN32
 u16 byteswap_16(u16 x) {
 	return _byteswap_ushort(x);
@@ -21,3 +23,124 @@ u64 byteswap_64(u64 x) {
 	return bswap_64(x);
 }
 #endif
+
+static void swap(u16 &x) { x = byteswap_16(x); }
+static void swap(i16 &x) { x = (i16)byteswap_16((u16)x); }
+static void swap(u32 &x) { x = byteswap_32(x); }
+static void swap(i32 &x) { x = (i32)byteswap_32((u32)x); }
+static void swap(u64 &x) { x = byteswap_64(x); }
+static void swap(f32 &x) {
+	u32 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	bits = byteswap_32(bits);
+	memcpy(&x, &bits, sizeof(bits));
+}
+
+static bool isBigEndian() {
+	return get_system_endianness() == endianness::big;
+}
+
+void storeLittleEndian(PackHeader &header) {
+	if (!isBigEndian()) {
+		return;
+	}
+	swap(header.magic);
+	swap(header.version);
+	swap(header.alignment);
+	swap(header.hash.seed);
+	swap(header.hash.bucketCount);
+	swap(header.hash.assetCount);
+}
+
+void storeLittleEndian(Entry &entry) {
+	if (!isBigEndian()) {
+		return;
+	}
+	swap(entry.hash);
+	swap(entry.offset);
+	swap(entry.size);
+	swap(entry.rawSize);
+	u32 type = entry.type;
+	swap(type);
+	entry.type = (AssetType)type;
+	swap(entry.flags);
+}
+
+void storeLittleEndian(TextureMetadata &metadata) {
+	if (!isBigEndian()) {
+		return;
+	}
+	swap(metadata.width);
+	swap(metadata.height);
+	swap(metadata.bitDepth);
+	u32 format = metadata.format;
+	swap(format);
+	metadata.format = (TextureFormat)format;
+	swap(metadata.mipLevels);
+	for (u64 &offset : metadata.mipOffsets) {
+		swap(offset);
+	}
+}
+
+void storeLittleEndian(ModelMetadata &metadata) {
+	if (!isBigEndian()) {
+		return;
+	}
+	swap(metadata.vertexCount);
+	swap(metadata.indexCount);
+	for (f32 &offset : metadata.positionOffset) {
+		swap(offset);
+	}
+	swap(metadata.positionScale);
+}
+
+void storeLittleEndian(VoxelModelMetadata &metadata) {
+	if (!isBigEndian()) {
+		return;
+	}
+	swap(metadata.width);
+	swap(metadata.height);
+	swap(metadata.depth);
+	swap(metadata.amount_voxels);
+}
+
+void storeLittleEndian(i32 *values, size_t count) {
+	for (size_t i = 0; i < count && isBigEndian(); i++) {
+		swap(values[i]);
+	}
+}
+
+void storeLittleEndian(u16 *values, size_t count) {
+	for (size_t i = 0; i < count && isBigEndian(); i++) {
+		swap(values[i]);
+	}
+}
+
+void storeLittleEndian(u32 *values, size_t count) {
+	for (size_t i = 0; i < count && isBigEndian(); i++) {
+		swap(values[i]);
+	}
+}
+
+void storeLittleEndian(PackedVertex *vertices, size_t count) {
+	if (!isBigEndian()) {
+		return;
+	}
+	for (size_t i = 0; i < count; i++) {
+		PackedVertex &vertex = vertices[i];
+		for (u16 &pos : vertex.pos) {
+			swap(pos);
+		}
+		for (u32 c = 0; c < 2; c++) {
+			swap(vertex.normal[c]);
+			swap(vertex.tangent[c]);
+			swap(vertex.texCoord[c]);
+		}
+	}
+}
+
+void storeLittleEndian(Voxel *voxels, size_t count) {
+	for (size_t i = 0; i < count && isBigEndian(); i++) {
+		swap(voxels[i].color);
+	}
+}
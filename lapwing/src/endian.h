@@ -1,9 +1,13 @@
+#pragma once
+
 #if _WIN32
 #include <stdlib.h>
 #else
 #include <byteswap.h>
 #endif
 
+#include <cstddef>
+
 #include "lapwing.h"
 
 enum endianness {
@@ -23,3 +27,16 @@ inline endianness get_system_endianness()
 u16 byteswap_16(u16 x);
 u32 byteswap_32(u32 x);
 u64 byteswap_64(u64 x);
+
+// The pack is little endian. These convert in place right before writing and
+// do nothing on little endian hosts.
+void storeLittleEndian(PackHeader &header);
+void storeLittleEndian(Entry &entry);
+void storeLittleEndian(TextureMetadata &metadata);
+void storeLittleEndian(ModelMetadata &metadata);
+void storeLittleEndian(VoxelModelMetadata &metadata);
+void storeLittleEndian(i32 *values, size_t count);
+void storeLittleEndian(u16 *values, size_t count);
+void storeLittleEndian(u32 *values, size_t count);
+void storeLittleEndian(PackedVertex *vertices, size_t count);
+void storeLittleEndian(Voxel *voxels, size_t count);
@@ -11,3 +11,12 @@ std::string getBasename(fs::path path) {
 bool fileExists(fs::path path) {
 	return fs::exists(path);
 }
+
+int64_t getModifiedTime(fs::path path) {
+	std::error_code error;
+	fs::file_time_type time = fs::last_write_time(path, error);
+	if (error) {
+		return -1;
+	}
+	return time.time_since_epoch().count();
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <filesystem>
 #include <string>
 namespace fs = std::filesystem;
@@ -8,3 +9,7 @@ std::string getExtension(fs::path path);
 std::string getBasename(fs::path path);
 
 bool fileExists(fs::path path);
+
+// Last write time in the filesystem clock's ticks, or -1 if the file is
+// missing. Only meaningful compared against another value from this function.
+int64_t getModifiedTime(fs::path path);
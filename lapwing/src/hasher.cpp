@@ -1,67 +1,187 @@
 #include "hasher.h"
-#include <cmath>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
 
-Hash findPerfectHash(std::vector<std::string> assets) {
-	u32 startAmount = 1;
-	u32 endAmount = 0;
-	u32 prime = 31;
-	bool incStart = false;
+// NOTE: Average keys per bucket. Higher means a smaller displacement table but
+// longer searches for the large buckets.
+const size_t KEYS_PER_BUCKET = 4;
+const i32 MAX_DISPLACEMENT = 1 << 20;
 
-	while (true) {
-		std::set<u64> hashes;
-		for (auto assetFull: assets) {
-			std::string asset = getBasename(assetFull);
+u64 PerfectHash::slot(u64 id) const {
+	return perfectHashLookup(hash, displacements.data(), id);
+}
 
-			u32 power = 1;
-			u64 hash = asset.length();
-			u64 assetLen = asset.length();
+// Places every bucket with two or more keys by searching for a displacement
+// that sends all of them to free slots, largest buckets first. Single keys go
+// straight into whatever slots are left. Returns false if some bucket could
+// not be placed, in which case the caller retries with another seed.
+static bool placeBuckets(PerfectHash &perfectHash,
+						 const std::vector<u64> &ids) {
+	Hash &hash = perfectHash.hash;
+	size_t n = ids.size();
 
-			for (size_t i = 0; i < startAmount; i++) {
-				hash += (static_cast<u64>(asset[i % assetLen]) - 33) * static_cast<u64>(std::pow(prime, power++));
-			}
+	std::vector<u64> keys(n);
+	std::vector<u32> bucketSizes(hash.bucketCount, 0);
+	for (size_t i = 0; i < n; i++) {
+		keys[i] = perfectHashBucketKey(hash, ids[i]);
+		bucketSizes[keys[i] % hash.bucketCount]++;
+	}
 
-			for (size_t i = 0; i < endAmount; i++) {
-				hash += (static_cast<u64>(asset[(assetLen - i) % assetLen]) - 33) * static_cast<u64>(std::pow(prime, power++));
-			}
-			
-			if (hashes.find(hash) != hashes.end()) {
-				hashes.clear();
-				if (incStart) {
-					startAmount++;
-				} else {
-					endAmount++;
+	// Counting sort of the keys by bucket, then of the buckets by size, so the
+	// whole build stays linear.
+	std::vector<u32> bucketStart(hash.bucketCount + 1, 0);
+	u32 maxBucketSize = 0;
+	for (u32 b = 0; b < hash.bucketCount; b++) {
+		bucketStart[b + 1] = bucketStart[b] + bucketSizes[b];
+		maxBucketSize = std::max(maxBucketSize, bucketSizes[b]);
+	}
+	std::vector<u64> bucketKeys(n);
+	std::vector<u32> fill(bucketStart.begin(), bucketStart.end() - 1);
+	for (u64 key : keys) {
+		bucketKeys[fill[key % hash.bucketCount]++] = key;
+	}
+	std::vector<std::vector<u32>> bucketsBySize(maxBucketSize + 1);
+	for (u32 b = 0; b < hash.bucketCount; b++) {
+		bucketsBySize[bucketSizes[b]].push_back(b);
+	}
+
+	perfectHash.displacements.assign(hash.bucketCount, 0);
+	std::vector<bool> taken(n, false);
+	std::vector<u64> slots(maxBucketSize);
+	for (u32 size = maxBucketSize; size >= 2; size--) {
+		for (u32 b : bucketsBySize[size]) {
+			const u64 *bucket = &bucketKeys[bucketStart[b]];
+			i32 d = 0;
+			for (; d < MAX_DISPLACEMENT; d++) {
+				bool fits = true;
+				for (u32 k = 0; k < size && fits; k++) {
+					slots[k] = perfectHashSlot(hash, bucket[k], d);
+					fits = !taken[slots[k]];
+					for (u32 j = 0; j < k && fits; j++) {
+						fits = slots[j] != slots[k];
+					}
+				}
+				if (fits) {
+					break;
 				}
-				incStart = !incStart;
-			} else {
-				hashes.insert(hash);
+			}
+			if (d == MAX_DISPLACEMENT) {
+				return false;
+			}
+
+			perfectHash.displacements[b] = d;
+			for (u32 k = 0; k < size; k++) {
+				taken[slots[k]] = true;
 			}
 		}
-		if (hashes.size() == assets.size()) {
-			break;
+	}
+
+	size_t freeSlot = 0;
+	for (u32 b : bucketsBySize[1]) {
+		while (taken[freeSlot]) {
+			freeSlot++;
 		}
+		taken[freeSlot] = true;
+		perfectHash.displacements[b] = -(i32)freeSlot - 1;
 	}
+	return true;
+}
 
-	Hash hash = {};
-	hash.assetCount = assets.size();
-	hash.startChars = startAmount;
-	hash.endChars = endAmount;
-	hash.prime = prime;
+PerfectHash findPerfectHash(const std::vector<std::string> &assets) {
+	std::vector<u64> ids(assets.size());
+	std::unordered_map<u64, size_t> seen;
+	for (size_t i = 0; i < assets.size(); i++) {
+		ids[i] = hashAsset(assets[i]);
+		auto [other, inserted] = seen.insert({ids[i], i});
+		if (!inserted) {
+			std::cerr << "Assets " << assets[other->second] << " and "
+					  << assets[i] << " have the same ID." << std::endl;
+			exit(1);
+		}
+	}
 
-	return hash;
+	PerfectHash perfectHash = {};
+	perfectHash.hash.assetCount = assets.size();
+	perfectHash.hash.bucketCount =
+		std::max<size_t>(1, (assets.size() + KEYS_PER_BUCKET - 1) /
+								KEYS_PER_BUCKET);
+	if (assets.empty()) {
+		perfectHash.displacements.assign(1, 0);
+		return perfectHash;
+	}
+
+	for (u64 attempt = 0;; attempt++) {
+		perfectHash.hash.seed = mixHash(attempt);
+		if (placeBuckets(perfectHash, ids)) {
+			return perfectHash;
+		}
+	}
 }
 
-u64 hashAsset(Hash hash, std::string name) {
-	std::string asset = getBasename(name);
-	u32 power = 1;
-	u64 value = asset.length();
-	u64 assetLen = asset.length();
+u64 hashAsset(std::string name) {
+	return hashAssetName(getBasename(name).c_str());
+}
+
+static std::string constantName(const std::string &basename) {
+	std::string name = "ASSET_";
+	for (char c : basename) {
+		name += std::isalnum((unsigned char)c) ? std::toupper((unsigned char)c)
+												 : '_';
+	}
+	return name;
+}
 
-	for (size_t i = 0; i < hash.startChars; i++) {
-		value += (static_cast<u64>(asset[i % assetLen]) - 33) * static_cast<u64>(std::pow(hash.prime, power++));
+void writeAssetIDHeader(const std::string &filename,
+						const std::vector<std::string> &assets,
+						const Entry *tableOfContents, size_t assetCount) {
+	std::ofstream header(filename, std::ofstream::out | std::ofstream::trunc);
+	if (header.fail()) {
+		std::cerr << "Failed to write asset ID header " << filename << "."
+				  << std::endl;
+		return;
 	}
-	for (size_t i = 0; i < hash.endChars; i++) {
-		value += (static_cast<u64>(asset[(assetLen - i) % assetLen]) - 33) * static_cast<u64>(std::pow(hash.prime, power++));
+
+	header << "// Generated by lapwing from the asset list. Do not edit.\n"
+		   << "#pragma once\n\n"
+		   << "#include <lapwing.h>\n\n";
+
+	// NOTE: Assets that failed to pack are written with size 0, naming them
+	// would only defer the failure to runtime
+	std::unordered_map<std::string, std::string> names;
+	for (size_t i = 0; i < assetCount; i++) {
+		const std::string &asset = assets[i];
+		if (tableOfContents[i].size == 0) {
+			std::cerr << "Asset " << asset << " was not packed, skipping it."
+					  << std::endl;
+			continue;
+		}
+
+		std::string basename = getBasename(asset);
+		std::string name = constantName(basename);
+		auto [other, inserted] = names.insert({name, asset});
+		if (!inserted) {
+			std::cerr << "Assets " << other->second << " and " << asset
+					  << " both map to " << name << ", skipping it."
+					  << std::endl;
+			continue;
+		}
+
+		header << "constexpr u64 " << name << " = 0x" << std::hex
+			   << hashAsset(asset) << std::dec << "ull; // " << asset << "\n"
+			   << "static_assert(" << name << " == hashAssetName(\""
+			   << basename << "\"));\n";
 	}
 
-	return value;
+	header << "\nconstexpr u64 KNOWN_ASSET_IDS[] = {\n";
+	for (size_t i = 0; i < assetCount; i++) {
+		if (tableOfContents[i].size == 0) {
+			continue;
+		}
+		header << "\t0x" << std::hex << tableOfContents[i].hash << std::dec
+			   << "ull,\n";
+	}
+	header << "};\n";
 }
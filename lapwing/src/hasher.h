@@ -1,9 +1,24 @@
 #include "lapwing.h"
 #include "file_utils.h"
 #include <vector>
-#include <set>
 #include <string>
 
-Hash findPerfectHash(std::vector<std::string> assets);
+struct PerfectHash {
+	Hash hash;
+	std::vector<i32> displacements;
 
-u64 hashAsset(Hash hash, std::string name);
\ No newline at end of file
+	u64 slot(u64 id) const;
+};
+
+// Builds a minimal perfect hash over the assets' IDs in expected linear time.
+// Exits if two assets share a basename, as they would share an ID.
+PerfectHash findPerfectHash(const std::vector<std::string> &assets);
+
+u64 hashAsset(std::string name);
+
+// Writes a C++ header declaring an ASSET_<NAME> constant and a KNOWN_ASSET_IDS
+// entry, which plover's assetID() checks names against, for every asset that
+// was packed. The table of contents is in the order of the asset list.
+void writeAssetIDHeader(const std::string &filename,
+						const std::vector<std::string> &assets,
+						const Entry *tableOfContents, size_t assetCount);
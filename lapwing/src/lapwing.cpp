@@ -1,42 +1,110 @@
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+#include <thread>
 
 #include "lz4.h"
 #include "lapwing.h"
 #include "reader.h"
 #include "hasher.h"
 #include "writer.h"
+#include "packer.h"
+#include "manifest.h"
 #include "file_utils.h"
 
+#define PACK_FILE "assets.plv"
+#define PACK_TEMP_FILE PACK_FILE ".tmp"
+#define MANIFEST_FILE PACK_FILE ".manifest"
+#define ASSET_ID_HEADER "asset_ids.h"
+
+static void usage() {
+    std::cerr << "Usage: lapwing [-j N] [--no-compress] [--no-mesh-opt] [--no-bc] [--align N] [--force] <file_containing_list_of_assets>" << std::endl;
+    exit(1);
+}
+
 int main(int argc, char** argv) {
-    if (argc == 1 || argc > 2) {
-        std::cerr << "Usage: lapwing <file_containing_list_of_assets>" << std::endl;
-        exit(1);
+    const char* assetList = nullptr;
+    u32 jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    PackOptions options;
+    bool force = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+                usage();
+            }
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-compress") == 0) {
+            options.compress = false;
+        } else if (strcmp(argv[i], "--no-mesh-opt") == 0) {
+            options.optimizeMeshes = false;
+        } else if (strcmp(argv[i], "--no-bc") == 0) {
+            options.blockCompress = false;
+        } else if (strcmp(argv[i], "--align") == 0) {
+            // Power of two, so offsets stay aligned for any smaller power too
+            u32 alignment = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+            if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+                usage();
+            }
+            options.alignment = alignment;
+            i++;
+        } else if (strcmp(argv[i], "--force") == 0) {
+            force = true;
+        } else if (assetList == nullptr) {
+            assetList = argv[i];
+        } else {
+            usage();
+        }
+    }
+    if (assetList == nullptr) {
+        usage();
     }
 
-    if (!fileExists(argv[1])) {
+    if (!fileExists(assetList)) {
         std::cerr << "Asset list cannot be found." << std::endl;
         exit(1);
     }
 
-    std::vector assets = readAssetList(argv[1]);
-    Hash hash = findPerfectHash(assets);
+    std::vector assets = readAssetList(assetList);
+    // Each packer worker encodes its own textures, levels are only split
+    // across the threads left over when there are fewer assets than jobs
+    u32 packers =
+        (u32)std::max<size_t>(std::min<size_t>(jobs, assets.size()), 1);
+    options.encodeThreads = std::max<u32>(jobs / packers, 1);
+    PerfectHash perfectHash = findPerfectHash(assets);
+    Hash hash = perfectHash.hash;
     Entry* tableOfContents = (Entry*) calloc(hash.assetCount, ENTRY_SIZE);
-    Writer writer("assets.plv", hash.assetCount);
-    writer.writeHash(hash);
-
-    uintptr_t offset = HASH_SIZE + ENTRY_SIZE * hash.assetCount;
-    for (size_t i = 0; i < hash.assetCount; i++) {
-        tableOfContents[i].hash = hashAsset(hash, assets[i]); 
-        tableOfContents[i].offset = offset;        
-        offset = writer.writeAsset(tableOfContents[i], assets[i]);
-		printf("Name: %s\nHash: %zu\nSize: %zu\nOffset: %zu\n", assets[i].c_str(), tableOfContents[i].hash, tableOfContents[i].size, tableOfContents[i].offset);
+    Entry* slots = (Entry*) calloc(hash.assetCount, ENTRY_SIZE);
+
+    Manifest previous{};
+    if (force || !readManifest(MANIFEST_FILE, previous) ||
+        previous.optionsHash != hashPackOptions(options)) {
+        previous.entries.clear();
     }
+    Manifest manifest{};
+    manifest.optionsHash = hashPackOptions(options);
+
+    // NOTE: Unchanged blobs are copied out of the old pack, so the new one is
+    // written next to it and only replaces it once complete.
+    {
+        Writer writer(PACK_TEMP_FILE, hash.assetCount, options);
+        writer.writeHeader(hash, perfectHash.displacements);
 
-    std::sort(tableOfContents, tableOfContents + hash.assetCount);
-    writer.writeTableOfContents(tableOfContents);
+        packAssets(writer, assets, hash, tableOfContents, jobs, previous,
+                   PACK_FILE, manifest);
+
+        for (size_t i = 0; i < hash.assetCount; i++) {
+            slots[perfectHash.slot(tableOfContents[i].hash)] = tableOfContents[i];
+        }
+        writer.writeTableOfContents(slots);
+    }
+    fs::rename(PACK_TEMP_FILE, PACK_FILE);
+    writeManifest(MANIFEST_FILE, manifest);
+    writeAssetIDHeader(ASSET_ID_HEADER, assets, tableOfContents,
+                       hash.assetCount);
 
-    printf("Prime: %d\nStart Amount: %d\nEnd Amount: %d\nAsset Count: %zd\n", hash.prime, hash.startChars, hash.endChars, hash.assetCount);
+    printf("Seed: %zu\nBuckets: %d\nAsset Count: %zd\n", hash.seed, hash.bucketCount, hash.assetCount);
 
     free(tableOfContents);
+    free(slots);
 }
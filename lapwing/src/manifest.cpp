@@ -0,0 +1,101 @@
+#include "manifest.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// FNV-1a, 64 bit
+const u64 FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+const u64 FNV_PRIME = 0x100000001b3ull;
+
+static u64 fnv1a(u64 hash, const void *data, size_t size) {
+	const u8 *bytes = (const u8 *)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+u64 hashBytes(const void *data, size_t size) {
+	return fnv1a(FNV_OFFSET_BASIS, data, size);
+}
+
+bool hashFile(const std::string &path, u64 &hash) {
+	std::ifstream file(path, std::ifstream::in | std::ifstream::binary);
+	if (file.fail()) {
+		return false;
+	}
+
+	std::vector<char> buffer(1 << 16);
+	hash = FNV_OFFSET_BASIS;
+	while (file) {
+		file.read(buffer.data(), buffer.size());
+		hash = fnv1a(hash, buffer.data(), file.gcount());
+	}
+	return file.eof();
+}
+
+// Format: a header line "lapwing-manifest <version> <options hash>", then one
+// line per asset with its fields separated by spaces. The path comes last so
+// it may contain spaces itself.
+bool readManifest(const std::string &filename, Manifest &manifest) {
+	std::ifstream file(filename);
+	if (file.fail()) {
+		return false;
+	}
+
+	std::string magic;
+	u32 version = 0;
+	file >> magic >> version >> manifest.optionsHash;
+	if (file.fail() || magic != "lapwing-manifest" ||
+		version != MANIFEST_VERSION) {
+		std::cerr << "Ignoring outdated manifest " << filename << "."
+				  << std::endl;
+		return false;
+	}
+
+	std::string line;
+	std::getline(file, line);
+	while (std::getline(file, line)) {
+		if (line.empty()) {
+			continue;
+		}
+
+		std::istringstream fields(line);
+		ManifestEntry entry{};
+		u32 type = 0;
+		fields >> entry.mtime >> entry.contentHash >> entry.blobHash >> type >>
+			entry.flags >> entry.offset >> entry.size >> entry.rawSize;
+		fields.get();
+		std::getline(fields, entry.path);
+		if (fields.fail() || entry.path.empty()) {
+			std::cerr << "Ignoring malformed manifest " << filename << "."
+					  << std::endl;
+			manifest.entries.clear();
+			return false;
+		}
+		entry.type = (AssetType)type;
+		manifest.entries[entry.path] = entry;
+	}
+	return true;
+}
+
+void writeManifest(const std::string &filename, const Manifest &manifest) {
+	std::ofstream file(filename, std::ofstream::out | std::ofstream::trunc);
+	if (file.fail()) {
+		std::cerr << "Failed to write manifest " << filename << "."
+				  << std::endl;
+		return;
+	}
+
+	file << "lapwing-manifest " << MANIFEST_VERSION << " "
+		 << manifest.optionsHash << "\n";
+	for (const auto &[path, entry] : manifest.entries) {
+		file << entry.mtime << " " << entry.contentHash << " "
+			 << entry.blobHash << " " << (u32)entry.type << " " << entry.flags
+			 << " " << entry.offset << " " << entry.size << " "
+			 << entry.rawSize << " " << entry.path << "\n";
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <map>
+
+#include "lapwing.h"
+
+// Bump whenever the bytes lapwing emits for an asset change, so stale
+// manifests force a full repack.
+#define MANIFEST_VERSION 5
+
+// What the previous run knew about one source asset, and where its blob
+// lives in the pack it wrote.
+struct ManifestEntry {
+	std::string path;
+	i64 mtime;
+	u64 contentHash;
+	u64 blobHash;
+	AssetType type;
+	u32 flags;
+	u64 offset;
+	u64 size;
+	u64 rawSize;
+};
+
+struct Manifest {
+	u64 optionsHash;
+	std::map<std::string, ManifestEntry> entries;
+};
+
+// Returns false if the manifest is missing, malformed or from another
+// version, in which case every asset is treated as dirty.
+bool readManifest(const std::string &filename, Manifest &manifest);
+
+void writeManifest(const std::string &filename, const Manifest &manifest);
+
+u64 hashBytes(const void *data, size_t size);
+
+// Hashes the contents of a file. Returns false if it cannot be read.
+bool hashFile(const std::string &path, u64 &hash);
\ No newline at end of file
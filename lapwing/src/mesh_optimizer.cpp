@@ -0,0 +1,217 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+void optimizeVertexCache(std::vector<u32> &indices, size_t vertexCount,
+						 u32 cacheSize) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Vertex to triangle adjacency, packed into one array
+	std::vector<u32> liveTriangles(vertexCount, 0);
+	for (u32 index : indices) {
+		liveTriangles[index]++;
+	}
+	std::vector<u32> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+	}
+	std::vector<u32> adjacency(indices.size());
+	std::vector<u32> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++) {
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<u32> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<u32> deadEnd;
+	std::vector<u32> candidates;
+	std::vector<u32> output;
+	output.reserve(indices.size());
+
+	u32 time = cacheSize + 1;
+	size_t cursor = 0;
+	i64 fanning = 0;
+	while (fanning >= 0) {
+		candidates.clear();
+		for (u32 a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1];
+			 a++) {
+			u32 triangle = adjacency[a];
+			if (emitted[triangle]) {
+				continue;
+			}
+			for (u32 k = 0; k < 3; k++) {
+				u32 v = indices[3 * triangle + k];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// Prefer the candidate that is oldest in the cache but will still be
+		// in it after its remaining triangles are emitted.
+		fanning = -1;
+		i64 best = -1;
+		for (u32 v : candidates) {
+			if (liveTriangles[v] == 0) {
+				continue;
+			}
+			i64 priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+				priority = time - cacheTime[v];
+			}
+			if (priority > best) {
+				best = priority;
+				fanning = v;
+			}
+		}
+
+		while (fanning < 0 && !deadEnd.empty()) {
+			u32 v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0) {
+				fanning = v;
+			}
+		}
+		while (fanning < 0 && cursor < vertexCount) {
+			if (liveTriangles[cursor] > 0) {
+				fanning = cursor;
+			}
+			cursor++;
+		}
+	}
+
+	indices = std::move(output);
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+						 std::vector<u32> &indices) {
+	const u32 UNUSED = ~0u;
+	std::vector<u32> remap(vertices.size(), UNUSED);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (u32 &index : indices) {
+		if (remap[index] == UNUSED) {
+			remap[index] = reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(reordered);
+}
+
+// Round to nearest even, flushing values below the smallest subnormal to 0.
+static u16 floatToHalf(f32 value) {
+	u32 bits;
+	memcpy(&bits, &value, sizeof(u32));
+	u32 sign = (bits >> 16) & 0x8000;
+	u32 exponentBits = (bits >> 23) & 0xff;
+	u32 mantissa = bits & 0x7fffff;
+
+	if (exponentBits == 0xff) {
+		return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+	}
+	i32 exponent = (i32)exponentBits - 127 + 15;
+	if (exponent >= 31) {
+		return sign | 0x7c00;
+	}
+	if (exponent <= 0) {
+		if (exponent < -10) {
+			return sign;
+		}
+		mantissa |= 0x800000;
+		u32 shift = 14 - exponent;
+		u32 half = mantissa >> shift;
+		u32 remainder = mantissa & ((1u << shift) - 1);
+		u32 middle = 1u << (shift - 1);
+		if (remainder > middle || (remainder == middle && (half & 1))) {
+			half++;
+		}
+		return sign | half;
+	}
+
+	u32 half = sign | (exponent << 10) | (mantissa >> 13);
+	u32 remainder = mantissa & 0x1fff;
+	// NOTE: A carry out of the mantissa correctly bumps the exponent
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		half++;
+	}
+	return half;
+}
+
+static i16 floatToSnorm16(f32 value) {
+	return (i16)std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Zero and degenerate (NaN) vectors encode to +Z.
+static void encodeOctahedral(glm::vec3 n, i16 out[2]) {
+	f32 l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (!(l1 > 0.0f)) {
+		out[0] = 0;
+		out[1] = 0;
+		return;
+	}
+
+	f32 x = n.x / l1;
+	f32 y = n.y / l1;
+	if (n.z < 0.0f) {
+		f32 foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		f32 foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	out[0] = floatToSnorm16(x);
+	out[1] = floatToSnorm16(y);
+}
+
+std::vector<PackedVertex> quantizeVertices(const std::vector<Vertex> &vertices,
+										   ModelMetadata &metadata) {
+	glm::vec3 minimum(0.0f);
+	glm::vec3 maximum(0.0f);
+	if (!vertices.empty()) {
+		minimum = maximum = vertices[0].pos;
+	}
+	for (const Vertex &vertex : vertices) {
+		minimum = glm::min(minimum, vertex.pos);
+		maximum = glm::max(maximum, vertex.pos);
+	}
+
+	// NOTE: One scale for all axes keeps the dequantization a uniform scale,
+	// so it can fold into the model matrix without skewing normals.
+	glm::vec3 extent = maximum - minimum;
+	f32 scale = std::max(extent.x, std::max(extent.y, extent.z));
+	if (scale <= 0.0f) {
+		scale = 1.0f;
+	}
+	metadata.positionOffset[0] = minimum.x;
+	metadata.positionOffset[1] = minimum.y;
+	metadata.positionOffset[2] = minimum.z;
+	metadata.positionScale = scale;
+
+	std::vector<PackedVertex> packed(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const Vertex &vertex = vertices[i];
+		PackedVertex &out = packed[i];
+		for (int k = 0; k < 3; k++) {
+			f32 unit = (vertex.pos[k] - minimum[k]) / scale;
+			out.pos[k] =
+				(u16)std::round(std::clamp(unit, 0.0f, 1.0f) * 65535.0f);
+		}
+		out.pos[3] = 0;
+		encodeOctahedral(vertex.normal, out.normal);
+		encodeOctahedral(vertex.tangent, out.tangent);
+		out.texCoord[0] = floatToHalf(vertex.texCoord.x);
+		out.texCoord[1] = floatToHalf(vertex.texCoord.y);
+	}
+	return packed;
+}
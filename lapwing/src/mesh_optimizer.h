@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include "lapwing.h"
+#include "writer.h"
+
+// Reorders triangles for the GPU's post-transform vertex cache, using
+// Tipsify (Sander et al. 2007) with a cache of `cacheSize` vertices.
+void optimizeVertexCache(std::vector<u32> &indices, size_t vertexCount,
+						 u32 cacheSize = 16);
+
+// Reorders vertices in the order the index buffer first uses them, so vertex
+// fetches walk the buffer mostly linearly.
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+						 std::vector<u32> &indices);
+
+// Converts to the packed vertex layout and fills in the position
+// dequantization parameters of `metadata`.
+std::vector<PackedVertex> quantizeVertices(const std::vector<Vertex> &vertices,
+										   ModelMetadata &metadata);
+
@@ -0,0 +1,180 @@
+#include "mipmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LAPWING_SSE2
+#endif
+
+const u32 TEXEL_SIZE = 4;
+const u32 LINEAR_TO_SRGB_STEPS = 4096;
+
+bool isLinearTexture(const std::string &path) {
+	return path.find("_nrm") != std::string::npos;
+}
+
+static f32 srgbToLinear(f32 c) {
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static f32 linearToSrgb(f32 c) {
+	return c <= 0.0031308f ? c * 12.92f
+						   : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+struct ColourTables {
+	f32 toLinear[256];
+	u8 toSrgb[LINEAR_TO_SRGB_STEPS + 1];
+
+	ColourTables() {
+		for (u32 i = 0; i < 256; i++) {
+			toLinear[i] = srgbToLinear(i / 255.0f);
+		}
+		for (u32 i = 0; i <= LINEAR_TO_SRGB_STEPS; i++) {
+			f32 c = linearToSrgb((f32)i / LINEAR_TO_SRGB_STEPS);
+			toSrgb[i] = (u8)std::lround(c * 255.0f);
+		}
+	}
+};
+
+static const ColourTables &colourTables() {
+	static const ColourTables tables;
+	return tables;
+}
+
+// Source texels a destination texel covers along one axis. Usually 2, but
+// the last texel of an odd axis also takes the leftover one, so no source
+// texel is dropped.
+struct Taps {
+	u32 index[3];
+	u32 count;
+};
+
+static std::vector<Taps> computeTaps(u32 srcSize, u32 dstSize) {
+	std::vector<Taps> taps(dstSize);
+	for (u32 i = 0; i < dstSize; i++) {
+		Taps &t = taps[i];
+		t.count = 0;
+		for (u32 k = 2 * i; k < std::min(2 * i + 2, srcSize); k++) {
+			t.index[t.count++] = k;
+		}
+		if (i == dstSize - 1 && srcSize > 1 && srcSize % 2 == 1) {
+			t.index[t.count++] = srcSize - 1;
+		}
+	}
+	return taps;
+}
+
+// Box filters `src` into `dst`. Texels are 4 floats, so one texel is exactly
+// one SSE register.
+static void downsample(const f32 *src, u32 srcWidth, u32 srcHeight, f32 *dst,
+					   u32 dstWidth, u32 dstHeight) {
+	std::vector<Taps> columns = computeTaps(srcWidth, dstWidth);
+	std::vector<Taps> rows = computeTaps(srcHeight, dstHeight);
+
+	for (u32 y = 0; y < dstHeight; y++) {
+		const Taps &row = rows[y];
+		f32 *out = dst + (size_t)y * dstWidth * TEXEL_SIZE;
+
+		for (u32 x = 0; x < dstWidth; x++) {
+			const Taps &column = columns[x];
+			f32 weight = 1.0f / (row.count * column.count);
+#ifdef LAPWING_SSE2
+			__m128 sum = _mm_setzero_ps();
+			for (u32 j = 0; j < row.count; j++) {
+				const f32 *line =
+					src + (size_t)row.index[j] * srcWidth * TEXEL_SIZE;
+				for (u32 i = 0; i < column.count; i++) {
+					sum = _mm_add_ps(
+						sum, _mm_loadu_ps(line + column.index[i] * TEXEL_SIZE));
+				}
+			}
+			_mm_storeu_ps(out + x * TEXEL_SIZE,
+						  _mm_mul_ps(sum, _mm_set1_ps(weight)));
+#else
+			for (u32 c = 0; c < TEXEL_SIZE; c++) {
+				f32 sum = 0.0f;
+				for (u32 j = 0; j < row.count; j++) {
+					const f32 *line =
+						src + (size_t)row.index[j] * srcWidth * TEXEL_SIZE;
+					for (u32 i = 0; i < column.count; i++) {
+						sum += line[column.index[i] * TEXEL_SIZE + c];
+					}
+				}
+				out[x * TEXEL_SIZE + c] = sum * weight;
+			}
+#endif
+		}
+	}
+}
+
+static void encodeLevel(const f32 *texels, size_t texelCount, u8 *out,
+						bool srgb) {
+	const ColourTables &tables = colourTables();
+	for (size_t i = 0; i < texelCount * TEXEL_SIZE; i++) {
+		f32 c = std::clamp(texels[i], 0.0f, 1.0f);
+		bool alpha = (i % TEXEL_SIZE) == 3;
+		if (srgb && !alpha) {
+			out[i] = tables.toSrgb[(u32)std::lround(c * LINEAR_TO_SRGB_STEPS)];
+		} else {
+			out[i] = (u8)std::lround(c * 255.0f);
+		}
+	}
+}
+
+std::vector<u8> generateMipChain(const u8 *pixels, TextureMetadata &metadata,
+								 bool srgb) {
+	u32 width = metadata.width;
+	u32 height = metadata.height;
+	metadata.bitDepth = TEXEL_SIZE;
+
+	u32 levels = 1;
+	while (levels < MAX_MIP_LEVELS &&
+		   ((width >> levels) > 0 || (height >> levels) > 0)) {
+		levels++;
+	}
+	metadata.mipLevels = levels;
+
+	size_t chainSize = 0;
+	for (u32 level = 0; level < levels; level++) {
+		metadata.mipOffsets[level] = chainSize;
+		chainSize += (size_t)std::max(1u, width >> level) *
+					 std::max(1u, height >> level) * TEXEL_SIZE;
+	}
+
+	std::vector<u8> chain(chainSize);
+	size_t levelSize = (size_t)width * height * TEXEL_SIZE;
+	memcpy(chain.data(), pixels, levelSize);
+	if (levels == 1) {
+		return chain;
+	}
+
+	// NOTE: Each level is filtered from the float level above it, not from
+	// the rounded bytes, so errors don't accumulate down the chain.
+	const ColourTables &tables = colourTables();
+	std::vector<f32> current(levelSize);
+	for (size_t i = 0; i < levelSize; i++) {
+		bool alpha = (i % TEXEL_SIZE) == 3;
+		current[i] = srgb && !alpha ? tables.toLinear[pixels[i]]
+									: pixels[i] / 255.0f;
+	}
+
+	std::vector<f32> next;
+	for (u32 level = 1; level < levels; level++) {
+		u32 srcWidth = std::max(1u, width >> (level - 1));
+		u32 srcHeight = std::max(1u, height >> (level - 1));
+		u32 dstWidth = std::max(1u, width >> level);
+		u32 dstHeight = std::max(1u, height >> level);
+
+		next.resize((size_t)dstWidth * dstHeight * TEXEL_SIZE);
+		downsample(current.data(), srcWidth, srcHeight, next.data(), dstWidth,
+				   dstHeight);
+		encodeLevel(next.data(), (size_t)dstWidth * dstHeight,
+					chain.data() + metadata.mipOffsets[level], srgb);
+		std::swap(current, next);
+	}
+	return chain;
+}
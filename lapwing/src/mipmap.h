@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "lapwing.h"
+
+// Normal maps and other data textures are named *_nrm and filtered as linear
+// data, everything else is treated as sRGB colour.
+bool isLinearTexture(const std::string &path);
+
+// Builds the full mip chain of an RGBA8 image down to 1x1, level 0 first, and
+// fills in the level count and offsets of `metadata`. Levels are box filtered
+// in linear light, so sRGB colour textures don't darken as they shrink.
+std::vector<u8> generateMipChain(const u8 *pixels, TextureMetadata &metadata,
+								 bool srgb);
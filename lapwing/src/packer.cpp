@@ -0,0 +1,170 @@
+#include "packer.h"
+#include "hasher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+// NOTE: Decoded blobs can be large (a 4k RGBA texture is 64MB), so workers may
+// only run this far ahead of the writer.
+const size_t MAX_BLOBS_IN_FLIGHT_PER_JOB = 4;
+
+static u64 alignOffset(u64 offset, u32 alignment) {
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Fills `record` with the current state of the source file, and `asset` with
+// the previous blob if the source has not changed since the last run.
+static bool reuseAsset(const std::string &path, const Manifest &previous,
+					   std::ifstream &previousPack, ManifestEntry &record,
+					   PackedAsset &asset) {
+	record.path = path;
+	record.mtime = getModifiedTime(path);
+
+	auto old = previous.entries.find(path);
+	if (old == previous.entries.end() || !previousPack.is_open()) {
+		hashFile(path, record.contentHash);
+		return false;
+	}
+
+	// NOTE: Only hash the source when its mtime moved, so a touched but
+	// identical file is still reused and a clean run reads no sources.
+	if (record.mtime == old->second.mtime) {
+		record.contentHash = old->second.contentHash;
+	} else if (!hashFile(path, record.contentHash) ||
+			   record.contentHash != old->second.contentHash) {
+		return false;
+	}
+
+	std::vector<char> blob(old->second.size);
+	previousPack.clear();
+	previousPack.seekg(old->second.offset, std::ios_base::beg);
+	previousPack.read(blob.data(), blob.size());
+	if (previousPack.fail() ||
+		hashBytes(blob.data(), blob.size()) != old->second.blobHash) {
+		return false;
+	}
+
+	record.blobHash = old->second.blobHash;
+	asset.type = old->second.type;
+	asset.valid = true;
+	asset.reused = true;
+	asset.flags = old->second.flags;
+	asset.rawSize = old->second.rawSize;
+	asset.blob = std::move(blob);
+	return true;
+}
+
+void packAssets(Writer &writer, const std::vector<std::string> &assets,
+				Hash hash, Entry *tableOfContents, u32 jobs,
+				const Manifest &previous, const std::string &previousPack,
+				Manifest &manifest) {
+	size_t assetCount = assets.size();
+	size_t window = std::max<size_t>(jobs, 1) * MAX_BLOBS_IN_FLIGHT_PER_JOB;
+
+	std::vector<PackedAsset> packed(assetCount);
+	std::vector<ManifestEntry> records(assetCount);
+	std::vector<bool> done(assetCount, false);
+	std::atomic<size_t> nextAsset{0};
+	size_t assetsWritten = 0;
+
+	std::mutex mutex;
+	std::condition_variable assetReady;
+	std::condition_variable windowOpen;
+
+	auto worker = [&]() {
+		std::ifstream pack(previousPack,
+						   std::ifstream::in | std::ifstream::binary);
+		while (true) {
+			size_t i = nextAsset.fetch_add(1);
+			if (i >= assetCount) {
+				return;
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				windowOpen.wait(lock, [&] { return i < assetsWritten + window; });
+			}
+
+			PackedAsset asset{};
+			if (!reuseAsset(assets[i], previous, pack, records[i], asset)) {
+				asset = writer.packAsset(assets[i]);
+				records[i].blobHash =
+					hashBytes(asset.blob.data(), asset.blob.size());
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				packed[i] = std::move(asset);
+				done[i] = true;
+			}
+			assetReady.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (u32 i = 0; i < std::max<u32>(jobs, 1); i++) {
+		workers.emplace_back(worker);
+	}
+
+	// Ordered writer stage: offsets only depend on the sizes of the blobs
+	// before this one, so the pack is byte-identical to a serial run.
+	u32 alignment = writer.options.alignment;
+	u64 offset = alignOffset(PACK_HEADER_SIZE + DISPLACEMENTS_SIZE(hash) +
+								 ENTRY_SIZE * assetCount,
+							 alignment);
+	size_t reusedCount = 0;
+	for (size_t i = 0; i < assetCount; i++) {
+		PackedAsset asset;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			assetReady.wait(lock, [&] { return done[i]; });
+			asset = std::move(packed[i]);
+			assetsWritten = i + 1;
+		}
+		windowOpen.notify_all();
+
+		tableOfContents[i].hash = hashAsset(assets[i]);
+		tableOfContents[i].offset = offset;
+		try {
+			offset = alignOffset(writer.writeAsset(tableOfContents[i], asset),
+								 alignment);
+		} catch (...) {
+			// Let the workers drain before unwinding
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				nextAsset = assetCount;
+				assetsWritten = assetCount;
+			}
+			windowOpen.notify_all();
+			for (std::thread &thread : workers) {
+				thread.join();
+			}
+			throw;
+		}
+		printf("Name: %s%s\nHash: %zu\nSize: %zu (raw %zu)\nOffset: %zu\n",
+			   assets[i].c_str(), asset.reused ? " (unchanged)" : "",
+			   tableOfContents[i].hash, tableOfContents[i].size,
+			   tableOfContents[i].rawSize, tableOfContents[i].offset);
+
+		if (asset.valid) {
+			ManifestEntry &record = records[i];
+			record.type = tableOfContents[i].type;
+			record.flags = tableOfContents[i].flags;
+			record.offset = tableOfContents[i].offset;
+			record.size = tableOfContents[i].size;
+			record.rawSize = tableOfContents[i].rawSize;
+			manifest.entries[record.path] = record;
+			reusedCount += asset.reused;
+		}
+	}
+
+	for (std::thread &thread : workers) {
+		thread.join();
+	}
+	printf("Reused %zu of %zu assets.\n", reusedCount, assetCount);
+}
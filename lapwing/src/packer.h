@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "lapwing.h"
+#include "manifest.h"
+#include "writer.h"
+
+// Decodes assets on `jobs` worker threads and writes them through `writer`
+// in list order, filling `tableOfContents` with IDs, offsets and sizes.
+// The output is identical whatever the job count.
+//
+// Assets whose source is unchanged since `previous` was written have their
+// blob copied from `previousPack` instead of being decoded again. Every asset
+// that was packed successfully is recorded in `manifest`.
+void packAssets(Writer &writer, const std::vector<std::string> &assets,
+				Hash hash, Entry *tableOfContents, u32 jobs,
+				const Manifest &previous, const std::string &previousPack,
+				Manifest &manifest);
@@ -1,8 +1,16 @@
 #include "writer.h"
 #include "file_utils.h"
 #include "lapwing.h"
+#include "bc_encoder.h"
+#include "endian.h"
+#include "lz4.h"
+#include "manifest.h"
+#include "mesh_optimizer.h"
+#include "mipmap.h"
 #include "vox.h"
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
@@ -10,10 +18,11 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <obj/tiny_obj_loader.h>
 
-Writer::Writer(std::string filename, size_t assetCount) {
+Writer::Writer(std::string filename, size_t assetCount, PackOptions options) {
 	assets =
 		new std::ofstream(filename, std::ofstream::out | std::ofstream::binary);
 	ToCLength = assetCount;
+	this->options = options;
 
 	// Images
 	extensionsToType[".png"] = AssetType::IMAGE;
@@ -35,169 +44,353 @@ Writer::Writer(std::string filename, size_t assetCount) {
 	extensionsToType[".vox"] = AssetType::VOXEL_MODEL;
 }
 
-void Writer::writeHash(Hash hash) {
+u64 hashPackOptions(const PackOptions &options) {
+	u8 fields[] = {options.compress, options.optimizeMeshes,
+				   options.blockCompress};
+	return hashBytes(fields, sizeof(fields));
+}
+
+void Writer::writeHeader(Hash hash, const std::vector<i32> &displacements) {
+	PackHeader header = {};
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.alignment = options.alignment;
+	header.hash = hash;
+	storeLittleEndian(header);
+
+	std::vector<i32> storedDisplacements = displacements;
+	storedDisplacements.resize(DISPLACEMENTS_SIZE(hash) / sizeof(i32));
+	storeLittleEndian(storedDisplacements.data(), storedDisplacements.size());
+
 	assets->seekp(0, std::ios_base::beg);
-	assets->write((char *)&hash, sizeof(Hash));
+	assets->write((char *)&header, PACK_HEADER_SIZE);
+	assets->write((char *)storedDisplacements.data(), DISPLACEMENTS_SIZE(hash));
+	ToCOffset = PACK_HEADER_SIZE + DISPLACEMENTS_SIZE(hash);
 }
 
 void Writer::writeTableOfContents(Entry *ToC) {
-	assets->seekp(sizeof(Hash), std::ios_base::beg);
-	assets->write((char *)ToC, ENTRY_SIZE * ToCLength);
+	std::vector<Entry> entries(ToC, ToC + ToCLength);
+	for (Entry &entry : entries) {
+		storeLittleEndian(entry);
+	}
+	assets->seekp(ToCOffset, std::ios_base::beg);
+	assets->write((char *)entries.data(), ENTRY_SIZE * ToCLength);
+}
+
+static void appendBlob(std::vector<char> &blob, const void *data,
+					   size_t size) {
+	const char *bytes = (const char *)data;
+	blob.insert(blob.end(), bytes, bytes + size);
 }
 
-uintptr_t Writer::writeImage(Entry &content, std::string path) {
-	content.type = AssetType::IMAGE;
+bool Writer::packImage(PackedAsset &asset, std::string path) const {
+	asset.type = AssetType::IMAGE;
 	TextureMetadata textureMetadata = {};
-	if (fileExists(path)) {
-		u8 *image =
-			stbi_load(path.c_str(), &textureMetadata.width,
-					  &textureMetadata.height, &textureMetadata.bitDepth, 0);
-		assets->write((char *)&textureMetadata, sizeof(TextureMetadata));
-		assets->write((char *)image, textureMetadata.width *
-										 textureMetadata.height *
-										 textureMetadata.bitDepth);
-		stbi_image_free(image);
-		content.size = sizeof(TextureMetadata) + textureMetadata.width *
-													 textureMetadata.height *
-													 textureMetadata.bitDepth;
-		return content.offset + content.size;
-	} else {
+	if (!fileExists(path)) {
 		std::cerr << "Asset file " << path << " does not exist." << std::endl;
+		return false;
+	}
+	// NOTE: Always expand to RGBA, the engine only uploads 4 channel images
+	int channels = 0;
+	u8 *image = stbi_load(path.c_str(), &textureMetadata.width,
+						  &textureMetadata.height, &channels, STBI_rgb_alpha);
+	if (image == nullptr) {
+		std::cerr << "Failed to decode image " << path << ": "
+				  << stbi_failure_reason() << std::endl;
+		return false;
+	}
+
+	bool normalMap = isLinearTexture(path);
+	std::vector<u8> chain =
+		generateMipChain(image, textureMetadata, !normalMap);
+	stbi_image_free(image);
+
+	textureMetadata.format = TEXTURE_RGBA8;
+	if (options.blockCompress) {
+		TextureFormat format = chooseBlockFormat(
+			chain.data(), (size_t)textureMetadata.width * textureMetadata.height,
+			normalMap);
+
+		size_t blocksSize = 0;
+		u64 blockOffsets[MAX_MIP_LEVELS];
+		for (u32 level = 0; level < textureMetadata.mipLevels; level++) {
+			blockOffsets[level] = blocksSize;
+			blocksSize += compressedLevelSize(
+				format, std::max(textureMetadata.width >> level, 1),
+				std::max(textureMetadata.height >> level, 1));
+		}
+
+		std::vector<u8> blocks(blocksSize);
+		for (u32 level = 0; level < textureMetadata.mipLevels; level++) {
+			compressLevel(format, chain.data() + textureMetadata.mipOffsets[level],
+						  std::max(textureMetadata.width >> level, 1),
+						  std::max(textureMetadata.height >> level, 1),
+						  blocks.data() + blockOffsets[level],
+						  options.encodeThreads);
+			textureMetadata.mipOffsets[level] = blockOffsets[level];
+		}
+		textureMetadata.format = format;
+		chain = std::move(blocks);
 	}
-	return -1;
+	storeLittleEndian(textureMetadata);
+
+	asset.blob.reserve(sizeof(TextureMetadata) + chain.size());
+	appendBlob(asset.blob, &textureMetadata, sizeof(TextureMetadata));
+	appendBlob(asset.blob, chain.data(), chain.size());
+	return true;
 }
 
-uintptr_t Writer::writeVoxelModel(Entry &content, std::string path) {
-	content.type = AssetType::VOXEL_MODEL;
+bool Writer::packVoxelModel(PackedAsset &asset, std::string path) const {
+	asset.type = AssetType::VOXEL_MODEL;
 	VoxelModelMetadata modelMetadata{};
 	if (!fileExists(path)) {
 		std::cerr << "Asset file " << path << " does not exist." << std::endl;
-		return -1;
+		return false;
 	}
 	u8 *model = vox_load(path, &modelMetadata.width, &modelMetadata.height,
 						 &modelMetadata.depth, &modelMetadata.amount_voxels);
 	if (model == nullptr) {
-		return -1;
+		return false;
 	}
 
-	assets->write((char *)&modelMetadata, sizeof(VoxelModelMetadata));
-    uint32_t model_size = sizeof(Voxel) * modelMetadata.amount_voxels;
-	assets->write((char *)model, model_size);
-	content.size = sizeof(VoxelModelMetadata) + model_size;
+	uint32_t model_size = sizeof(Voxel) * modelMetadata.amount_voxels;
+	storeLittleEndian((Voxel *)model, modelMetadata.amount_voxels);
+	storeLittleEndian(modelMetadata);
+	asset.blob.reserve(sizeof(VoxelModelMetadata) + model_size);
+	appendBlob(asset.blob, &modelMetadata, sizeof(VoxelModelMetadata));
+	appendBlob(asset.blob, model, model_size);
 	free(model);
-
-	return content.offset + content.size;
+	return true;
 }
 
-uintptr_t Writer::writeModel(Entry &content, std::string path) {
-	content.type = AssetType::MODEL;
+bool Writer::packModel(PackedAsset &asset, std::string path) const {
+	asset.type = AssetType::MODEL;
 	ModelMetadata modelMetadata = {};
-	if (fileExists(path)) {
-		tinyobj::attrib_t attrib;
-		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
-		std::string warn, err;
-		std::vector<Vertex> vertices;
-		std::vector<uint32_t> indices;
-
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-							  path.c_str())) {
-			throw std::runtime_error(warn + err);
-		}
+	if (!fileExists(path)) {
+		std::cerr << "Asset file " << path << " does not exist." << std::endl;
+		return false;
+	}
+
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
+						  path.c_str())) {
+		throw std::runtime_error(warn + err);
+	}
+
+	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+
+	for (const auto &shape : shapes) {
+		int i = 0;
+		for (const auto &index : shape.mesh.indices) {
+			Vertex vertex{};
+
+			vertex.pos = {attrib.vertices[3 * index.vertex_index + 0],
+						  attrib.vertices[3 * index.vertex_index + 1],
+						  attrib.vertices[3 * index.vertex_index + 2]};
+
+			vertex.normal = {attrib.normals[3 * index.normal_index + 0],
+							 attrib.normals[3 * index.normal_index + 1],
+							 attrib.normals[3 * index.normal_index + 2]};
+
+			vertex.tangent = {};
 
-		std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-
-		for (const auto &shape : shapes) {
-			int i = 0;
-			for (const auto &index : shape.mesh.indices) {
-				Vertex vertex{};
-
-				vertex.pos = {attrib.vertices[3 * index.vertex_index + 0],
-							  attrib.vertices[3 * index.vertex_index + 1],
-							  attrib.vertices[3 * index.vertex_index + 2]};
-
-				vertex.normal = {attrib.normals[3 * index.normal_index + 0],
-								 attrib.normals[3 * index.normal_index + 1],
-								 attrib.normals[3 * index.normal_index + 2]};
-
-				vertex.tangent = {};
-
-				vertex.texCoord = {
-					attrib.texcoords[2 * index.texcoord_index + 0],
-					1.0f - attrib.texcoords[2 * index.texcoord_index +
-											1] // NOTE(oliver): Flip to conform
-											   // to OBJ
-				};
-
-				if (uniqueVertices.count(vertex) == 0) {
-					uniqueVertices[vertex] =
-						static_cast<uint32_t>(vertices.size());
-					vertices.push_back(vertex);
-				}
-
-				indices.push_back(uniqueVertices[vertex]);
-
-				i++;
-				if ((i % 3) == 0) { // NOTE(oliver): Performed per tri
-					u64 indicesSize = indices.size();
-					u32 i0 = indices[indicesSize - 3];
-					u32 i1 = indices[indicesSize - 2];
-					u32 i2 = indices[indicesSize - 1];
-					Vertex &v0 = vertices[i0];
-					Vertex &v1 = vertices[i1];
-					Vertex &v2 = vertices[i2];
-					glm::vec3 v0v1 = v1.pos - v0.pos;
-					glm::vec3 v0v2 = v2.pos - v0.pos;
-
-					glm::vec2 deltaUV1 = v1.texCoord - v0.texCoord;
-					glm::vec2 deltaUV2 = v2.texCoord - v0.texCoord;
-					float k =
-						1 / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-					glm::vec3 tangent = glm::vec3(
-						k * (deltaUV2.y * v0v1.x - deltaUV1.y * v0v2.x),
-						k * (deltaUV2.y * v0v1.y - deltaUV1.y * v0v2.y),
-						k * (deltaUV2.y * v0v1.z - deltaUV1.y * v0v2.z));
-
-					v0.tangent = tangent;
-					v1.tangent = tangent;
-					v2.tangent = tangent;
-				}
+			vertex.texCoord = {
+				attrib.texcoords[2 * index.texcoord_index + 0],
+				1.0f - attrib.texcoords[2 * index.texcoord_index +
+										1] // NOTE(oliver): Flip to conform
+										   // to OBJ
+			};
+
+			if (uniqueVertices.count(vertex) == 0) {
+				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(vertex);
+			}
+
+			indices.push_back(uniqueVertices[vertex]);
+
+			i++;
+			if ((i % 3) == 0) { // NOTE(oliver): Performed per tri
+				u64 indicesSize = indices.size();
+				u32 i0 = indices[indicesSize - 3];
+				u32 i1 = indices[indicesSize - 2];
+				u32 i2 = indices[indicesSize - 1];
+				Vertex &v0 = vertices[i0];
+				Vertex &v1 = vertices[i1];
+				Vertex &v2 = vertices[i2];
+				glm::vec3 v0v1 = v1.pos - v0.pos;
+				glm::vec3 v0v2 = v2.pos - v0.pos;
+
+				glm::vec2 deltaUV1 = v1.texCoord - v0.texCoord;
+				glm::vec2 deltaUV2 = v2.texCoord - v0.texCoord;
+				float k =
+					1 / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+
+				glm::vec3 tangent =
+					glm::vec3(k * (deltaUV2.y * v0v1.x - deltaUV1.y * v0v2.x),
+							  k * (deltaUV2.y * v0v1.y - deltaUV1.y * v0v2.y),
+							  k * (deltaUV2.y * v0v1.z - deltaUV1.y * v0v2.z));
+
+				v0.tangent = tangent;
+				v1.tangent = tangent;
+				v2.tangent = tangent;
 			}
 		}
+	}
 
-		modelMetadata.vertexCount = vertices.size();
-		modelMetadata.indexCount = indices.size();
+	if (options.optimizeMeshes) {
+		optimizeVertexCache(indices, vertices.size());
+		optimizeVertexFetch(vertices, indices);
+	}
+	std::vector<PackedVertex> packedVertices =
+		quantizeVertices(vertices, modelMetadata);
+
+	modelMetadata.vertexCount = vertices.size();
+	modelMetadata.indexCount = indices.size();
+	modelMetadata.indexSize =
+		vertices.size() <= UINT16_MAX + 1 ? sizeof(u16) : sizeof(u32);
+
+	size_t vertexCount = vertices.size();
+	size_t indexCount = indices.size();
+	u8 indexSize = modelMetadata.indexSize;
+	ModelMetadata storedMetadata = modelMetadata;
+	storeLittleEndian(storedMetadata);
+	storeLittleEndian(packedVertices.data(), vertexCount);
+
+	asset.blob.reserve(sizeof(ModelMetadata) +
+					   vertexCount * sizeof(PackedVertex) +
+					   indexCount * indexSize);
+	appendBlob(asset.blob, &storedMetadata, sizeof(ModelMetadata));
+	appendBlob(asset.blob, packedVertices.data(),
+			   vertexCount * sizeof(PackedVertex));
+	if (indexSize == sizeof(u16)) {
+		std::vector<u16> shortIndices(indices.begin(), indices.end());
+		storeLittleEndian(shortIndices.data(), indexCount);
+		appendBlob(asset.blob, shortIndices.data(), indexCount * sizeof(u16));
+	} else {
+		storeLittleEndian(indices.data(), indexCount);
+		appendBlob(asset.blob, indices.data(), indexCount * sizeof(u32));
+	}
+	return true;
+}
 
-		assets->write((char *)&modelMetadata, sizeof(ModelMetadata));
-		assets->write((char *)vertices.data(),
-					  modelMetadata.vertexCount * sizeof(Vertex));
-		assets->write((char *)indices.data(),
-					  modelMetadata.indexCount * sizeof(uint32_t));
+static size_t metadataSize(AssetType type) {
+	switch (type) {
+	case AssetType::IMAGE:
+		return sizeof(TextureMetadata);
+	case AssetType::MODEL:
+		return sizeof(ModelMetadata);
+	case AssetType::VOXEL_MODEL:
+		return sizeof(VoxelModelMetadata);
+	}
+	return 0;
+}
 
-		content.size = sizeof(ModelMetadata) +
-					   modelMetadata.vertexCount * sizeof(Vertex) +
-					   modelMetadata.indexCount * sizeof(uint32_t);
-		return content.offset + content.size;
-	} else {
-		std::cerr << "Asset file " << path << " does not exist." << std::endl;
+// NOTE: Only plain LZ4 is vendored, so the per-type choice is the
+// acceleration factor; LZ4HC emits the same block format if we ever need the
+// extra ratio. Textures are the bulk of the pack and compress well, vertex
+// floats barely compress and are not worth slowing the pack down for.
+static int compressionAcceleration(AssetType type) {
+	switch (type) {
+	case AssetType::IMAGE:
+	case AssetType::VOXEL_MODEL:
+		return 1;
+	case AssetType::MODEL:
+		return 8;
 	}
-	return -1;
+	return 1;
 }
 
-uintptr_t Writer::writeAsset(Entry &content, std::string path) {
-	assets->seekp(content.offset, std::ios_base::beg);
-	std::string ext = getExtension(path);
-	AssetType type = extensionsToType[ext];
+void Writer::compress(PackedAsset &asset) const {
+	size_t headerSize = metadataSize(asset.type);
+	if (asset.blob.size() <= headerSize) {
+		return;
+	}
+
+	const char *payload = asset.blob.data() + headerSize;
+	size_t payloadSize = asset.blob.size() - headerSize;
+	int acceleration = compressionAcceleration(asset.type);
+
+	std::vector<char> compressed(asset.blob.begin(),
+								 asset.blob.begin() + headerSize);
+	compressed.reserve(asset.blob.size());
+	std::vector<char> block(LZ4_compressBound(COMPRESSED_BLOCK_SIZE));
+
+	// NOTE: The source stays in place for the whole loop, so the stream can
+	// match against all previous blocks without saving a dictionary.
+	LZ4_stream_t *stream = LZ4_createStream();
+	for (size_t p = 0; p < payloadSize; p += COMPRESSED_BLOCK_SIZE) {
+		int blockSize =
+			(int)std::min<size_t>(COMPRESSED_BLOCK_SIZE, payloadSize - p);
+		int compressedSize =
+			LZ4_compress_fast_continue(stream, payload + p, block.data(),
+									   blockSize, block.size(), acceleration);
+		u32 size = compressedSize;
+		storeLittleEndian(&size, 1);
+		compressed.insert(compressed.end(), (char *)&size,
+						  (char *)&size + sizeof(u32));
+		compressed.insert(compressed.end(), block.data(),
+						  block.data() + compressedSize);
+	}
+	LZ4_freeStream(stream);
+
+	// Keep incompressible assets raw so they load with a single read
+	if (compressed.size() < asset.blob.size() - asset.blob.size() / 16) {
+		asset.blob = std::move(compressed);
+		asset.flags |= ENTRY_COMPRESSED;
+	}
+}
 
-	if (type == AssetType::IMAGE) {
-		return writeImage(content, path);
-	} else if (type == AssetType::MODEL) {
-		return writeModel(content, path);
-	} else if (type == AssetType::VOXEL_MODEL) {
-		return writeVoxelModel(content, path);
+PackedAsset Writer::packAsset(std::string path) const {
+	PackedAsset asset{};
+	auto type = extensionsToType.find(getExtension(path));
+	if (type == extensionsToType.end()) {
+		std::cerr << "Asset file " << path << " has an unknown extension."
+				  << std::endl;
+		return asset;
+	}
+
+	try {
+		if (type->second == AssetType::IMAGE) {
+			asset.valid = packImage(asset, path);
+		} else if (type->second == AssetType::MODEL) {
+			asset.valid = packModel(asset, path);
+		} else if (type->second == AssetType::VOXEL_MODEL) {
+			asset.valid = packVoxelModel(asset, path);
+		}
+		asset.rawSize = asset.blob.size();
+		if (asset.valid && options.compress) {
+			compress(asset);
+		}
+	} catch (...) {
+		// NOTE: Rethrown by the writer so failures surface in pack order
+		asset.error = std::current_exception();
 	}
-	return -1;
+	return asset;
+}
+
+u64 Writer::writeAsset(Entry &content, const PackedAsset &asset) {
+	if (asset.error) {
+		std::rethrow_exception(asset.error);
+	}
+	content.type = asset.type;
+	content.flags = asset.flags;
+	content.size = 0;
+	content.rawSize = 0;
+	if (!asset.valid) {
+		return content.offset;
+	}
+
+	assets->seekp(content.offset, std::ios_base::beg);
+	assets->write(asset.blob.data(), asset.blob.size());
+	content.size = asset.blob.size();
+	content.rawSize = asset.rawSize;
+	return content.offset + content.size;
 }
 
 Writer::~Writer() { assets->close(); };
@@ -4,8 +4,10 @@
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <exception>
 #include <map>
 #include <string>
+#include <vector>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
@@ -17,25 +19,57 @@
 #include "file_utils.h"
 #include "lapwing.h"
 
+struct PackOptions {
+	bool compress = true;
+	bool optimizeMeshes = true;
+	bool blockCompress = true;
+	// Threads used to encode each texture level. Doesn't affect the output.
+	u32 encodeThreads = 1;
+	// Blobs start at multiples of this. Only moves blobs, so it isn't part of
+	// the options hash and blobs stay reusable across alignments.
+	u32 alignment = DEFAULT_PACK_ALIGNMENT;
+};
+
+// Changes whenever an option that affects the packed bytes changes.
+u64 hashPackOptions(const PackOptions &options);
+
+// An asset decoded and preprocessed into the exact bytes it occupies in the
+// pack. Produced by worker threads, consumed in order by the writer.
+struct PackedAsset {
+	AssetType type;
+	bool valid;
+	bool reused;
+	u32 flags;
+	size_t rawSize;
+	std::vector<char> blob;
+	std::exception_ptr error;
+};
+
 struct Writer {
 	std::ofstream *assets;
 	size_t ToCLength;
+	u64 ToCOffset;
+	PackOptions options;
 	std::unordered_map<std::string, AssetType> extensionsToType;
 
-	Writer(std::string filename, size_t assetCount);
+	Writer(std::string filename, size_t assetCount, PackOptions options);
 
-	void writeHash(Hash hash);
+	void writeHeader(Hash hash, const std::vector<i32> &displacements);
 
 	void writeTableOfContents(Entry *ToC);
 
-	uintptr_t writeAsset(Entry &content, std::string path);
+	// Thread-safe: only reads the source file and the extension table.
+	PackedAsset packAsset(std::string path) const;
+
+	u64 writeAsset(Entry &content, const PackedAsset &asset);
 
 	~Writer();
 
   private:
-	uintptr_t writeImage(Entry &content, std::string path);
-	uintptr_t writeModel(Entry &content, std::string path);
-	uintptr_t writeVoxelModel(Entry &content, std::string path);
+	bool packImage(PackedAsset &asset, std::string path) const;
+	bool packModel(PackedAsset &asset, std::string path) const;
+	bool packVoxelModel(PackedAsset &asset, std::string path) const;
+	void compress(PackedAsset &asset) const;
 };
 
 struct Vertex {
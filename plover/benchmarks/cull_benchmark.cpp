@@ -0,0 +1,75 @@
+// Times cullBoxes against the scalar reference over a scene of random boxes,
+// about half of them in view. Build with -DPLOVER_BENCHMARKS=ON.
+#include "../src/CpuCulling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#define BENCHMARK_BOXES (1u << 16)
+#define BENCHMARK_ITERATIONS 1000
+
+typedef u32 (*CullFunction)(const Frustum &, const CullBounds &, u32 *);
+
+internal_func f64 boxesPerNanosecond(CullFunction cull,
+									 const Frustum &frustum,
+									 const CullBounds &bounds, u32 *visible,
+									 u32 *visibleCount) {
+	auto start = std::chrono::steady_clock::now();
+	for (u32 i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		*visibleCount = cull(frustum, bounds, visible);
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	f64 nanoseconds =
+		(f64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+			.count();
+	return (f64)bounds.count * BENCHMARK_ITERATIONS / nanoseconds;
+}
+
+int main() {
+	// A box shaped frustum covering half of the scene along x
+	Frustum frustum = {{
+		{1, 0, 0, 0},
+		{-1, 0, 0, 50},
+		{0, 1, 0, 50},
+		{0, -1, 0, 50},
+		{0, 0, 1, 50},
+		{0, 0, -1, 50},
+	}};
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<f32> position(-50.0f, 50.0f);
+	std::uniform_real_distribution<f32> extent(0.1f, 2.0f);
+	CullBounds bounds;
+	bounds.resize(BENCHMARK_BOXES);
+	for (u32 i = 0; i < BENCHMARK_BOXES; i++) {
+		f32 min[3], max[3];
+		for (u32 c = 0; c < 3; c++) {
+			min[c] = position(random);
+			max[c] = min[c] + extent(random);
+		}
+		bounds.set(i, min, max);
+	}
+
+	std::vector<u32> visible(BENCHMARK_BOXES), reference(BENCHMARK_BOXES);
+	u32 visibleCount, referenceCount;
+	f64 simd = boxesPerNanosecond(cullBoxes, frustum, bounds, visible.data(),
+								  &visibleCount);
+	f64 scalar = boxesPerNanosecond(cullBoxesScalar, frustum, bounds,
+									reference.data(), &referenceCount);
+
+	if (visibleCount != referenceCount ||
+		!std::equal(visible.begin(), visible.begin() + visibleCount,
+					reference.begin())) {
+		fprintf(stderr, "cullBoxes disagrees with the scalar reference!\n");
+		return 1;
+	}
+
+	printf("%u boxes, %u visible\n", BENCHMARK_BOXES, visibleCount);
+	printf("cullBoxes:       %.3f boxes/ns\n", simd);
+	printf("cullBoxesScalar: %.3f boxes/ns\n", scalar);
+	return 0;
+}
@@ -77,6 +77,7 @@ struct Handles {
 	void (*pushRenderCommand)(RenderCommand);
 	bool (*hasRenderMessage)();
 	RenderMessage (*popRenderMessage)();
+	UploadStats (*getUploadStats)();
 
     // UI
     void (*UI_Clear)();
@@ -1,3 +1,29 @@
+#include <lapwing.h>
+
+// Asset IDs are the hash lapwing gives an asset's basename in the pack's table
+// of contents. When the header lapwing generates is on the include path, names
+// that are not in the pack fail to compile.
+#if __has_include(<asset_ids.h>)
+#include <asset_ids.h>
+#define PLOVER_KNOWN_ASSET_IDS
+#endif
+
+typedef u64 AssetID;
+
+consteval AssetID assetID(const char *name) {
+	AssetID id = hashAssetName(name);
+#ifdef PLOVER_KNOWN_ASSET_IDS
+	bool known = false;
+	for (AssetID knownID : KNOWN_ASSET_IDS) {
+		known |= knownID == id;
+	}
+	if (!known) {
+		throw "unknown asset name, is it in assets.txt?";
+	}
+#endif
+	return id;
+}
+
 struct Camera {
 	glm::vec3 position;
 	glm::vec3 direction;
@@ -6,19 +32,24 @@ struct Camera {
 enum RenderCommandTag {
 	CREATE_MESH,
 	CREATE_MATERIAL,
+	DESTROY_MESH,
 	SET_MESH_TRANSFORM,
 	SET_CAMERA,
 	SET_RENDER_MODE
 };
 
 struct CreateMeshData {
-	const char *name;
+	AssetID modelID;
 	u32 materialID;
 };
 
 struct CreateMaterialData {
-	const char *textureName;
-	const char *normalName;
+	AssetID textureID;
+	AssetID normalID;
+};
+
+struct DestroyMeshData {
+	u64 meshID;
 };
 
 struct SetMeshTransformData {
@@ -46,6 +77,7 @@ struct RenderCommand {
 	union {
 		CreateMeshData createMesh;
 		CreateMaterialData createMaterial;
+		DestroyMeshData destroyMesh;
 		SetMeshTransformData setMeshTransform;
 		SetCameraData setCamera;
 		SetRenderModeData setRenderMode;
@@ -74,3 +106,13 @@ struct RenderMessage {
 		 MaterialCreatedData materialCreated;
 	} v;
 };
+
+// Uploads streaming in over the next frames
+struct UploadStats {
+	u32 queuedUploads;
+	u32 queuedChunks;
+	u64 queuedBytes;
+	// Recorded last frame, out of the per frame budget
+	u64 recordedBytes;
+	f64 recordedMilliseconds;
+};
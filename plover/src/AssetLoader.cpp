@@ -1,107 +1,157 @@
 #include "AssetLoader.h"
 #include "Mesh.h"
 #include "lapwing.h"
+#include "plover_int.h"
+#include "../../lapwing/src/lz4.h"
 
+#include <algorithm>
+#include <bit>
 #include <cstdlib>
 #include <stdexcept>
 #include <string.h>
-#include <math.h>
 #include <iostream>
+#include <vector>
+
+// NOTE: Lapwing writes the pack little endian on every host, and it's read
+// straight out of the mapping here
+static_assert(std::endian::native == std::endian::little,
+			  "the asset pack can only be read on little endian hosts");
 
 AssetLoader::AssetLoader() {
-	assets = new std::ifstream("../resources/assets.plv", std::ifstream::in | std::ifstream::binary);
-	if (assets->fail()) {
+	if (!mapFile("../resources/assets.plv", &pack)) {
 		throw std::runtime_error("The assets file does not exist.");
 	}
-	assets->read((char*)&hash, HASH_SIZE);
-
-	for (size_t i = 0; i < hash.assetCount; i++)
-	{
-		Entry entry{};
-		assets->read((char*)&entry, ENTRY_SIZE);
-		
-		tableOfContents.insert({entry.hash, entry});
+	if (pack.size < PACK_HEADER_SIZE) {
+		throw std::runtime_error("The assets file is corrupted.");
 	}
-}
 
-char* AssetLoader::loadTexture(const char* name, TextureMetadata* info) {
-	u64 assetHash = hashAsset(name);
-	auto entryPair = tableOfContents.find(assetHash);
+	const PackHeader* header = (const PackHeader*)pack.data;
+	if (header->magic != PACK_MAGIC || header->version != PACK_VERSION) {
+		throw std::runtime_error("The assets file is from another version of lapwing, repack it.");
+	}
+	hash = header->hash;
+	alignment = header->alignment;
 
-	if (entryPair != tableOfContents.end()) {
-		Entry entry = entryPair->second;
-		assets->seekg(entry.offset, std::ios_base::beg);
-		assets->read((char*)info, sizeof(TextureMetadata));
+	u64 displacementsOffset = PACK_HEADER_SIZE;
+	u64 tableOffset = displacementsOffset + DISPLACEMENTS_SIZE(hash);
+	if (tableOffset + ENTRY_SIZE * hash.assetCount > pack.size) {
+		throw std::runtime_error("The assets file is corrupted.");
+	}
+	displacements = {(const i32*)(pack.data + displacementsOffset), hash.bucketCount};
+	tableOfContents = {(const Entry*)(pack.data + tableOffset), hash.assetCount};
+}
 
-		// TODO (yigit): Change this to use an arena once they are implemented.
-		char* texture = new char[entry.size - sizeof(TextureMetadata)];
+const Entry &AssetLoader::findEntry(u64 id) const {
+	if (hash.assetCount == 0) {
+		throw std::runtime_error("Asset not found.\n");
+	}
 
-		assets->read(texture, entry.size - sizeof(TextureMetadata));
-		return texture;
-	} else {
+	const Entry &entry =
+		tableOfContents[perfectHashLookup(hash, displacements.data(), id)];
+	if (entry.hash != id || entry.size == 0) {
 		throw std::runtime_error("Asset not found.\n");
 	}
+	if (entry.offset + entry.size > pack.size) {
+		throw std::runtime_error("Asset lies outside the assets file.\n");
+	}
+	return entry;
 }
 
-ModelData AssetLoader::loadModel(const char* name, ModelMetadata* info) {
-	u64 assetHash = hashAsset(name);
-	auto entryPair = tableOfContents.find(assetHash);
-	ModelData data;
-
-	if (entryPair != tableOfContents.end()) {
-		Entry entry = entryPair->second;
-		assets->seekg(entry.offset, std::ios_base::beg);
-		assets->read((char*)info, sizeof(ModelMetadata));
-
-		char* vertices = new char[info->vertexCount * sizeof(Vertex)];
-		assets->read(vertices, info->vertexCount * sizeof(Vertex));
+void AssetLoader::prefetch(u64 id) const {
+	const Entry &entry = findEntry(id);
+	prefetchMappedRange(&pack, entry.offset, entry.size);
+}
 
-		char* indices = new char[info->indexCount * sizeof(uint32_t)];
-		assets->read(indices, info->indexCount * sizeof(uint32_t));
+// Everything after the asset's metadata. Uncompressed payloads are returned in
+// place; compressed ones are decoded block by block into one allocation.
+AssetData AssetLoader::readPayload(const Entry &entry, size_t metadataSize,
+								   size_t payloadSize) const {
+	if (entry.rawSize - metadataSize != payloadSize) {
+		throw std::runtime_error("Asset size does not match its metadata.\n");
+	}
 
-		data.vertices = (u8*) vertices;
-		data.indices = (u8*) indices;
-	} else {
-		throw std::runtime_error("Asset not found.\n");
+	AssetData data;
+	const u8 *src = pack.data + entry.offset + metadataSize;
+	if (!(entry.flags & ENTRY_COMPRESSED)) {
+		data.bytes = {src, payloadSize};
+		return data;
 	}
 
-	return data; 
+	data.decoded = std::make_unique<u8[]>(payloadSize);
+	char *dst = (char *)data.decoded.get();
+	LZ4_streamDecode_t stream;
+	LZ4_setStreamDecode(&stream, nullptr, 0);
+
+	size_t written = 0;
+	size_t remaining = entry.size - metadataSize;
+	while (written < payloadSize) {
+		u32 blockSize = 0;
+		if (remaining < sizeof(u32)) {
+			throw std::runtime_error("Corrupted compressed asset.\n");
+		}
+		memcpy(&blockSize, src, sizeof(u32));
+		src += sizeof(u32);
+		remaining -= sizeof(u32);
+		if (blockSize > remaining) {
+			throw std::runtime_error("Corrupted compressed asset.\n");
+		}
+
+		int capacity = std::min<size_t>(COMPRESSED_BLOCK_SIZE, payloadSize - written);
+		int decoded = LZ4_decompress_safe_continue(
+			&stream, (const char *)src, dst + written, blockSize, capacity);
+		if (decoded <= 0) {
+			throw std::runtime_error("Corrupted compressed asset.\n");
+		}
+		src += blockSize;
+		remaining -= blockSize;
+		written += decoded;
+	}
+	data.bytes = {data.decoded.get(), payloadSize};
+	return data;
 }
 
-Voxel *AssetLoader::loadVoxelModel(const char *name, VoxelModelMetadata *info) {
-    u64 assetHash = hashAsset(name);
-    auto entryPair = tableOfContents.find(assetHash);
-    
-    if (entryPair == tableOfContents.end()) {
-        throw std::runtime_error("Asset not found.\n");
-        return nullptr;
-    }
-
-    Entry entry = entryPair->second;
-    assets->seekg(entry.offset, std::ios_base::beg);
-    assets->read((char *) info, sizeof(VoxelModelMetadata));
-
-    Voxel *voxels = (Voxel *) malloc(info->amount_voxels * sizeof(Voxel));
-    assets->read((char *) voxels, info->amount_voxels * sizeof(Voxel));
-    return voxels;
+AssetData AssetLoader::loadTexture(u64 id, TextureMetadata* info) const {
+	const Entry &entry = findEntry(id);
+	prefetchMappedRange(&pack, entry.offset, entry.size);
+	memcpy(info, pack.data + entry.offset, sizeof(TextureMetadata));
+
+	return readPayload(entry, sizeof(TextureMetadata),
+					   entry.rawSize - sizeof(TextureMetadata));
 }
 
-u64 AssetLoader::hashAsset(const char* name) {
-	u32 power = 1;
-	u64 value = strlen(name);
-	u64 assetLen = strlen(name);
+ModelData AssetLoader::loadModel(u64 id, ModelMetadata* info) const {
+	const Entry &entry = findEntry(id);
+	prefetchMappedRange(&pack, entry.offset, entry.size);
+	memcpy(info, pack.data + entry.offset, sizeof(ModelMetadata));
+
+	// NOTE: Compressed blocks can reference earlier output, so vertices
+	// and indices are decoded into one allocation.
+	size_t verticesSize = info->vertexCount * sizeof(Vertex);
+	size_t indicesSize = info->indexCount * info->indexSize;
+
+	ModelData model;
+	model.data = readPayload(entry, sizeof(ModelMetadata),
+							 verticesSize + indicesSize);
+	model.vertices = model.data.bytes.subspan(0, verticesSize);
+	model.indices = model.data.bytes.subspan(verticesSize, indicesSize);
+	return model;
+}
 
-	for (size_t i = 0; i < hash.startChars; i++) {
-		value += (static_cast<u64>(name[i % assetLen]) - 33) * static_cast<u64>(std::pow(hash.prime, power++));
-	}
+AssetData AssetLoader::loadVoxelModel(u64 id, VoxelModelMetadata *info) const {
+	const Entry &entry = findEntry(id);
+	prefetchMappedRange(&pack, entry.offset, entry.size);
+	memcpy(info, pack.data + entry.offset, sizeof(VoxelModelMetadata));
 
-	for (size_t i = 0; i < hash.endChars; i++) {
-		value += (static_cast<u64>(name[(assetLen - i) % assetLen]) - 33) * static_cast<u64>(std::pow(hash.prime, power++));
-	}
+	return readPayload(entry, sizeof(VoxelModelMetadata),
+					   info->amount_voxels * sizeof(Voxel));
+}
 
-	return value;
+u64 AssetLoader::hashAsset(const char* name) const {
+	return hashAssetName(name);
 }
 
 void AssetLoader::cleanup() {
-	assets->close();
+	unmapFile(&pack);
+	tableOfContents = {};
+	displacements = {};
 }
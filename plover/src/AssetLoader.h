@@ -3,27 +3,58 @@
 #include <plover/plover.h>
 #include <lapwing.h>
 
-#include <unordered_map>
-#include <string>
-#include <fstream>
+#include <memory>
+#include <span>
+#include <vector>
+
+// A read-only view of a whole file, see mapFile in plover_int.h
+struct MappedFile {
+	const u8* data;
+	u64 size;
+	void* handle; // Platform specific
+};
+
+// Payload of an asset. Uncompressed assets point straight into the mapped
+// pack, compressed ones own their decoded bytes. Either way, bytes stay valid
+// for as long as the AssetData and the loader are alive.
+struct AssetData {
+	std::span<const u8> bytes;
+	std::unique_ptr<u8[]> decoded;
+};
 
 struct ModelData {
-	u8* vertices;
-	u8* indices;
+	std::span<const u8> vertices;
+	std::span<const u8> indices;
+	AssetData data;
 };
 
+// NOTE: Nothing is mutated after construction, so any thread can load assets
+// at the same time.
 struct AssetLoader {
-	std::unordered_map<u64, Entry> tableOfContents;
-	std::ifstream* assets;
+	MappedFile pack;
+	std::span<const Entry> tableOfContents; // Indexed by perfect hash slot
+	std::span<const i32> displacements;
 	Hash hash;
+	u32 alignment; // Of every blob's offset in the pack
 
 	AssetLoader();
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
 
-	char* loadTexture(const char* name, TextureMetadata* info);
-	ModelData loadModel(const char* name, ModelMetadata* info);
-    Voxel *loadVoxelModel(const char *name, VoxelModelMetadata *info);
-	
-	u64 hashAsset(const char* name);
+	AssetData loadTexture(u64 id, TextureMetadata* info) const;
+	ModelData loadModel(u64 id, ModelMetadata* info) const;
+	AssetData loadVoxelModel(u64 id, VoxelModelMetadata* info) const;
+
+	// Asks the OS to start reading an asset in, so a later load doesn't stall
+	// on page faults.
+	void prefetch(u64 id) const;
+
+	u64 hashAsset(const char* name) const;
 
 	void cleanup();
+
+  private:
+	const Entry& findEntry(u64 id) const;
+	AssetData readPayload(const Entry& entry, size_t metadataSize,
+						  size_t payloadSize) const;
 };
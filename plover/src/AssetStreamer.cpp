@@ -0,0 +1,303 @@
+#include "AssetStreamer.h"
+#include "VulkanContext.h"
+
+#include <stdexcept>
+
+void AssetStreamer::init(VulkanContext *context, const AssetLoader *loader,
+						 GpuCache *cache) {
+	this->context = context;
+	this->loader = loader;
+	this->cache = cache;
+	nextRequest = 0;
+	workers.init(defaultWorkerCount());
+}
+
+void AssetStreamer::run(std::function<void()> job) {
+	workers.push([this, job] {
+		try {
+			job();
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			workerError = std::current_exception();
+		}
+	});
+}
+
+void AssetStreamer::request(RenderCommand command) {
+	if (command.tag != CREATE_MESH && command.tag != CREATE_MATERIAL) {
+		throw std::invalid_argument("failed to stream unsupported command!");
+	}
+
+	u64 key = nextRequest++;
+	PendingRequest &request = pending[key];
+	request = {};
+	request.command = command;
+
+	// NOTE: Assets are requested by update, which knows what's resident
+	if (command.tag == CREATE_MATERIAL) {
+		request.waitingOnPipeline = true;
+		run([this, key] {
+			Material material{};
+			createMaterialPipeline(*context, material);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			pipelines.push_back(
+				{key, material.pipeline, material.pipelineLayout});
+		});
+	}
+}
+
+void AssetStreamer::destroyMesh(size_t meshID) {
+	auto it = context->meshes.find(meshID);
+	if (it == context->meshes.end()) {
+		throw std::runtime_error("failed to destroy unknown mesh!");
+	}
+
+	// NOTE: Frames in flight may still draw it
+	retired.push_back({it->second, cache->frame});
+	context->meshes.erase(it);
+	context->sceneVersion++;
+}
+
+// Worker thread. Loads the asset, creates its device resources and builds
+// the upload filling them in.
+void AssetStreamer::stage(AssetLoad load) {
+	StagedAsset asset{};
+	asset.load = load;
+
+	try {
+		if (load.type == MODEL) {
+			auto model = std::make_shared<ModelData>(
+				loader->loadModel(load.id, &asset.model.metadata));
+			createMeshBuffers(*context, asset.model.metadata, asset.model);
+			asset.model.bounds = computeModelBounds(
+				model->vertices, asset.model.metadata.vertexCount);
+
+			asset.upload.addBuffer(model->vertices.data(),
+								   model->vertices.size(),
+								   context->geometry.vertexBuffer,
+								   asset.model.vertices.offset);
+			asset.upload.addBuffer(model->indices.data(), model->indices.size(),
+								   context->geometry.indexBuffer,
+								   asset.model.indices.offset);
+			asset.upload.source = model;
+		} else {
+			auto pixels = std::make_shared<AssetData>();
+			Bitmap bitmap =
+				loadImageBitmap(*context, *loader, load.id, load.format, *pixels);
+			createTextureResources(*context, bitmap, asset.texture);
+
+			asset.texture.addCopy(asset.upload, bitmap);
+			asset.upload.source = pixels;
+			// NOTE: Geometry unblocks more requests for its size
+			asset.upload.priority = UPLOAD_PRIORITY_LOW;
+		}
+	} catch (...) {
+		discard(asset);
+		throw;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	staged.push_back(asset);
+}
+
+// Main thread, from the upload scheduler once the last copy of an asset is
+// recorded
+void AssetStreamer::recorded(CacheKey key, u64 value) {
+	if (inFlight.empty() || inFlight.back().value != value) {
+		inFlight.push_back({value, {}});
+	}
+	inFlight.back().assets.push_back(scheduled.at(key));
+	scheduled.erase(key);
+}
+
+// Main thread, once every asset the request uses is resident
+RenderMessage AssetStreamer::complete(PendingRequest &request) {
+	RenderCommand &command = request.command;
+
+	if (command.tag == CREATE_MESH) {
+		u64 modelID = command.v.createMesh.modelID;
+		const CachedModel &model = cache->acquireModel(modelID);
+
+		Mesh *mesh = new Mesh{};
+		mesh->modelID = modelID;
+		mesh->vertexOffset = (i32)(model.vertices.offset / sizeof(Vertex));
+		mesh->firstIndex =
+			(u32)(model.indices.offset / model.metadata.indexSize);
+		mesh->bounds = model.bounds;
+
+		RenderMessage message{MESH_CREATED, command.id};
+		message.v.meshCreated.meshID = addMesh(
+			*context, mesh, model.metadata, command.v.createMesh.materialID);
+		return message;
+	}
+
+	CreateMaterialData materialData = command.v.createMaterial;
+	Material material{};
+	material.pipeline = request.pipeline;
+	material.pipelineLayout = request.pipelineLayout;
+	material.textureID = materialData.textureID;
+	material.normalID = materialData.normalID;
+	material.texture =
+		cache->acquireTexture(materialData.textureID, true).tableSlot;
+	material.normal =
+		cache->acquireTexture(materialData.normalID, false).tableSlot;
+
+	RenderMessage message{MATERIAL_CREATED, command.id};
+	message.v.materialCreated.materialID = addMaterial(*context, material);
+	return message;
+}
+
+// Frees whatever was created for an asset that will never be handed over
+void AssetStreamer::discard(StagedAsset &asset) {
+	context->geometry.freeVertices(asset.model.vertices);
+	context->geometry.freeIndices(asset.model.indices);
+
+	Texture &texture = asset.texture;
+	if (texture.image != VK_NULL_HANDLE) {
+		texture.cleanup(*context);
+	}
+}
+
+void AssetStreamer::update(MessageQueue<RenderMessage> &messages) {
+	std::vector<StagedAsset> ready;
+	std::vector<CreatedPipeline> created;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (workerError) {
+			std::exception_ptr error = workerError;
+			workerError = nullptr;
+			std::rethrow_exception(error);
+		}
+		ready.swap(staged);
+		created.swap(pipelines);
+	}
+
+	for (CreatedPipeline &pipeline : created) {
+		PendingRequest &request = pending.at(pipeline.request);
+		request.pipeline = pipeline.pipeline;
+		request.pipelineLayout = pipeline.pipelineLayout;
+		request.waitingOnPipeline = false;
+	}
+
+	// Hand the batches the GPU is done with over to the cache
+	for (auto batch = inFlight.begin(); batch != inFlight.end();) {
+		if (!context->uploads.isComplete(batch->value)) {
+			++batch;
+			continue;
+		}
+
+		for (StagedAsset &asset : batch->assets) {
+			if (asset.load.type == MODEL) {
+				cache->addModel(asset.load.id, asset.model);
+			} else {
+				cache->addTexture(asset.load.id, asset.load.key().srgb,
+								  asset.texture);
+			}
+			loading.erase(asset.load.key());
+		}
+		batch = inFlight.erase(batch);
+	}
+
+	// Answer the requests whose assets are resident, load the rest
+	for (auto it = pending.begin(); it != pending.end();) {
+		PendingRequest &request = it->second;
+
+		AssetLoad uses[2];
+		u32 useCount = 0;
+		if (request.command.tag == CREATE_MESH) {
+			uses[useCount++] = {request.command.v.createMesh.modelID, MODEL};
+		} else {
+			CreateMaterialData materialData = request.command.v.createMaterial;
+			uses[useCount++] = {materialData.textureID, IMAGE, SRGBA8};
+			uses[useCount++] = {materialData.normalID, IMAGE, RGBA8};
+		}
+
+		bool resident = !request.waitingOnPipeline;
+		for (u32 i = 0; i < useCount; i++) {
+			if (cache->contains(uses[i].key())) {
+				continue;
+			}
+			resident = false;
+			if (loading.insert(uses[i].key()).second) {
+				AssetLoad load = uses[i];
+				run([this, load] { stage(load); });
+			}
+		}
+
+		if (!resident) {
+			++it;
+			continue;
+		}
+		messages.push(complete(request));
+		it = pending.erase(it);
+	}
+
+	for (auto mesh = retired.begin(); mesh != retired.end();) {
+		if (cache->frame - mesh->frame <= MAX_FRAMES_IN_FLIGHT) {
+			++mesh;
+			continue;
+		}
+
+		cache->release({mesh->mesh->modelID});
+		delete mesh->mesh;
+		mesh = retired.erase(mesh);
+	}
+	cache->update();
+
+	// NOTE: The scheduler spreads the copies over as many frames as its
+	// budget needs, the asset is handed over once the last one completes
+	for (StagedAsset &asset : ready) {
+		CacheKey key = asset.load.key();
+		asset.upload.onRecorded = [this, key](u64 value) {
+			recorded(key, value);
+		};
+		asset.ticket = context->uploads.schedule(std::move(asset.upload));
+		asset.upload = {};
+		scheduled[key] = asset;
+	}
+}
+
+void AssetStreamer::cleanup() {
+	workers.cleanup();
+
+	for (auto &kv : scheduled) {
+		context->uploads.cancel(kv.second.ticket);
+	}
+	// Canceled uploads may have been partially recorded
+	context->uploads.wait(context->uploads.submit());
+	for (auto &kv : scheduled) {
+		discard(kv.second);
+	}
+	scheduled.clear();
+	for (UploadBatch &batch : inFlight) {
+		for (StagedAsset &asset : batch.assets) {
+			discard(asset);
+		}
+	}
+	inFlight.clear();
+
+	for (StagedAsset &asset : staged) {
+		discard(asset);
+	}
+	staged.clear();
+
+	for (CreatedPipeline &pipeline : pipelines) {
+		pending.at(pipeline.request).pipeline = pipeline.pipeline;
+		pending.at(pipeline.request).pipelineLayout = pipeline.pipelineLayout;
+	}
+	pipelines.clear();
+	for (auto &kv : pending) {
+		if (kv.second.pipeline != VK_NULL_HANDLE) {
+			context->pipelines.release(kv.second.pipeline);
+		}
+	}
+	pending.clear();
+
+	for (RetiredMesh &mesh : retired) {
+		cache->release({mesh.mesh->modelID});
+		delete mesh.mesh;
+	}
+	retired.clear();
+	workerError = nullptr;
+}
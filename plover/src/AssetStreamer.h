@@ -0,0 +1,108 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "AssetLoader.h"
+#include "GpuCache.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "MessageQueue.h"
+#include "ThreadPool.h"
+#include "UploadManager.h"
+
+#include <exception>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct VulkanContext;
+
+// Loads meshes and materials on worker threads and uploads them through the
+// upload scheduler, without waiting on the GPU. An asset only becomes visible to the renderer, and its
+// message is only posted, once its copies have completed. Models and textures
+// go through the cache, so each is only loaded once however many meshes and
+// materials use it.
+struct AssetStreamer {
+	void init(VulkanContext *context, const AssetLoader *loader,
+			  GpuCache *cache);
+	// Takes CREATE_MESH and CREATE_MATERIAL commands
+	void request(RenderCommand command);
+	void destroyMesh(size_t meshID);
+	// Main thread, once per frame. Schedules the uploads the workers staged,
+	// hands over what the GPU finished copying and answers the requests whose
+	// assets are all resident.
+	void update(MessageQueue<RenderMessage> &messages);
+	void cleanup();
+
+  private:
+	struct AssetLoad {
+		u64 id;
+		AssetType type;
+		BitmapFormat format; // Images only
+
+		CacheKey key() const { return {id, format == SRGBA8}; }
+	};
+
+	// A command waiting on the assets it uses
+	struct PendingRequest {
+		RenderCommand command;
+		// Materials only, created by a worker
+		bool waitingOnPipeline;
+		VkPipeline pipeline;
+		VkPipelineLayout pipelineLayout;
+	};
+
+	// Device resources of an asset, along with the upload filling them in
+	struct StagedAsset {
+		AssetLoad load;
+		Upload upload; // Moved out once scheduled
+		u64 ticket;
+
+		CachedModel model;
+		Texture texture;
+	};
+
+	struct CreatedPipeline {
+		u64 request;
+		VkPipeline pipeline;
+		VkPipelineLayout pipelineLayout;
+	};
+
+	struct UploadBatch {
+		u64 value; // Of the upload timeline
+		std::vector<StagedAsset> assets;
+	};
+
+	struct RetiredMesh {
+		Mesh *mesh;
+		u64 frame;
+	};
+
+	VulkanContext *context;
+	const AssetLoader *loader;
+	GpuCache *cache;
+	ThreadPool workers;
+
+	// Shared with the workers
+	std::mutex mutex;
+	std::vector<StagedAsset> staged;
+	std::vector<CreatedPipeline> pipelines;
+	std::exception_ptr workerError;
+
+	std::map<u64, PendingRequest> pending; // In request order
+	u64 nextRequest;
+	// Staged or in flight
+	std::unordered_set<CacheKey, CacheKeyHash> loading;
+	// Not recorded yet
+	std::unordered_map<CacheKey, StagedAsset, CacheKeyHash> scheduled;
+	std::vector<UploadBatch> inFlight;
+	std::vector<RetiredMesh> retired;
+
+	void run(std::function<void()> job);
+	void stage(AssetLoad load);
+	void recorded(CacheKey key, u64 value);
+	RenderMessage complete(PendingRequest &request);
+	void discard(StagedAsset &asset);
+};
@@ -0,0 +1,156 @@
+#include "CpuCulling.h"
+
+// NOTE: SIMD paths need GCC style target attributes, other compilers and
+// architectures test one box at a time
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CULL_X86
+#include <immintrin.h>
+#endif
+
+void CullBounds::resize(u32 count) {
+	this->count = count;
+	size_t padded = (count + CULL_BOUNDS_PADDING - 1) / CULL_BOUNDS_PADDING *
+					CULL_BOUNDS_PADDING;
+	for (std::vector<f32> *component :
+		 {&minX, &minY, &minZ, &maxX, &maxY, &maxZ}) {
+		component->resize(padded);
+	}
+}
+
+// A box is outside when its corner furthest along a plane's normal is still
+// behind it. Which corner that is only depends on the plane, so every box
+// tested against it reads the same component arrays.
+struct PlaneCorner {
+	const f32 *x, *y, *z;
+};
+
+internal_func PlaneCorner planeCorner(const f32 plane[4],
+									  const CullBounds &bounds) {
+	PlaneCorner corner;
+	corner.x = plane[0] >= 0 ? bounds.maxX.data() : bounds.minX.data();
+	corner.y = plane[1] >= 0 ? bounds.maxY.data() : bounds.minY.data();
+	corner.z = plane[2] >= 0 ? bounds.maxZ.data() : bounds.minZ.data();
+	return corner;
+}
+
+u32 cullBoxesScalar(const Frustum &frustum, const CullBounds &bounds,
+					u32 *visible) {
+	PlaneCorner corners[6];
+	for (u32 p = 0; p < 6; p++) {
+		corners[p] = planeCorner(frustum.planes[p], bounds);
+	}
+
+	u32 visibleCount = 0;
+	for (u32 i = 0; i < bounds.count; i++) {
+		bool inside = true;
+		for (u32 p = 0; p < 6 && inside; p++) {
+			const f32 *plane = frustum.planes[p];
+			f32 distance = plane[0] * corners[p].x[i] +
+						   plane[1] * corners[p].y[i] +
+						   plane[2] * corners[p].z[i] + plane[3];
+			inside = !(distance < 0);
+		}
+		if (inside) {
+			visible[visibleCount++] = i;
+		}
+	}
+	return visibleCount;
+}
+
+#ifdef CULL_X86
+// Appends the boxes set in `mask`, a bit per box from `first` on
+internal_func u32 writeVisible(u32 mask, u32 first, u32 *visible) {
+	u32 written = 0;
+	while (mask) {
+		visible[written++] = first + (u32)__builtin_ctz(mask);
+		mask &= mask - 1;
+	}
+	return written;
+}
+
+// Mask of the boxes that exist in the block starting at `first`
+internal_func u32 blockMask(u32 first, u32 width, u32 count) {
+	u32 remaining = count - first;
+	return remaining >= width ? (1u << width) - 1 : (1u << remaining) - 1;
+}
+
+__attribute__((target("avx2"))) internal_func u32
+cullBoxesAVX2(const Frustum &frustum, const CullBounds &bounds, u32 *visible) {
+	PlaneCorner corners[6];
+	__m256 planes[6][4];
+	for (u32 p = 0; p < 6; p++) {
+		corners[p] = planeCorner(frustum.planes[p], bounds);
+		for (u32 c = 0; c < 4; c++) {
+			planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+		}
+	}
+
+	u32 visibleCount = 0;
+	__m256 zero = _mm256_setzero_ps();
+	for (u32 i = 0; i < bounds.count; i += 8) {
+		__m256 outside = zero;
+		for (u32 p = 0; p < 6; p++) {
+			__m256 distance = planes[p][3];
+			distance = _mm256_add_ps(
+				distance,
+				_mm256_mul_ps(planes[p][0], _mm256_loadu_ps(corners[p].x + i)));
+			distance = _mm256_add_ps(
+				distance,
+				_mm256_mul_ps(planes[p][1], _mm256_loadu_ps(corners[p].y + i)));
+			distance = _mm256_add_ps(
+				distance,
+				_mm256_mul_ps(planes[p][2], _mm256_loadu_ps(corners[p].z + i)));
+			outside = _mm256_or_ps(
+				outside, _mm256_cmp_ps(distance, zero, _CMP_LT_OQ));
+		}
+		u32 mask = ~(u32)_mm256_movemask_ps(outside) &
+				   blockMask(i, 8, bounds.count);
+		visibleCount += writeVisible(mask, i, visible + visibleCount);
+	}
+	return visibleCount;
+}
+
+internal_func u32 cullBoxesSSE(const Frustum &frustum,
+							   const CullBounds &bounds, u32 *visible) {
+	PlaneCorner corners[6];
+	__m128 planes[6][4];
+	for (u32 p = 0; p < 6; p++) {
+		corners[p] = planeCorner(frustum.planes[p], bounds);
+		for (u32 c = 0; c < 4; c++) {
+			planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+		}
+	}
+
+	u32 visibleCount = 0;
+	__m128 zero = _mm_setzero_ps();
+	for (u32 i = 0; i < bounds.count; i += 4) {
+		__m128 outside = zero;
+		for (u32 p = 0; p < 6; p++) {
+			__m128 distance = planes[p][3];
+			distance = _mm_add_ps(
+				distance, _mm_mul_ps(planes[p][0], _mm_loadu_ps(corners[p].x + i)));
+			distance = _mm_add_ps(
+				distance, _mm_mul_ps(planes[p][1], _mm_loadu_ps(corners[p].y + i)));
+			distance = _mm_add_ps(
+				distance, _mm_mul_ps(planes[p][2], _mm_loadu_ps(corners[p].z + i)));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+		}
+		u32 mask = ~(u32)_mm_movemask_ps(outside) &
+				   blockMask(i, 4, bounds.count);
+		visibleCount += writeVisible(mask, i, visible + visibleCount);
+	}
+	return visibleCount;
+}
+#endif
+
+u32 cullBoxes(const Frustum &frustum, const CullBounds &bounds, u32 *visible) {
+#ifdef CULL_X86
+	local_persist bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2) {
+		return cullBoxesAVX2(frustum, bounds, visible);
+	}
+	return cullBoxesSSE(frustum, bounds, visible);
+#else
+	return cullBoxesScalar(frustum, bounds, visible);
+#endif
+}
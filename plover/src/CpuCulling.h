@@ -0,0 +1,42 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include <vector>
+
+// Six planes facing inwards, xyz the normal and w the distance. A point p is
+// inside a plane when dot(xyz, p) + w >= 0.
+struct Frustum {
+	f32 planes[6][4];
+};
+
+// World space bounding boxes, one array per component so SIMD tests load
+// several boxes at once. Arrays are padded to CULL_BOUNDS_PADDING, boxes past
+// count are never reported.
+#define CULL_BOUNDS_PADDING 8
+
+struct CullBounds {
+	std::vector<f32> minX, minY, minZ;
+	std::vector<f32> maxX, maxY, maxZ;
+	u32 count = 0;
+
+	void resize(u32 count);
+	void set(u32 i, const f32 min[3], const f32 max[3]) {
+		minX[i] = min[0];
+		minY[i] = min[1];
+		minZ[i] = min[2];
+		maxX[i] = max[0];
+		maxY[i] = max[1];
+		maxZ[i] = max[2];
+	}
+};
+
+// Writes the indices of the boxes touching the frustum to `visible` in
+// ascending order, and returns how many there are. `visible` holds at least
+// bounds.count entries. Tests 8 boxes at a time with AVX2 where the CPU has
+// it, 4 with SSE otherwise.
+u32 cullBoxes(const Frustum &frustum, const CullBounds &bounds, u32 *visible);
+
+// Same results one box at a time, for reference
+u32 cullBoxesScalar(const Frustum &frustum, const CullBounds &bounds,
+					u32 *visible);
@@ -0,0 +1,268 @@
+#include "DepthPyramid.h"
+#include "VulkanContext.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+internal_func u32 previousPowerOfTwo(u32 value) {
+	u32 power = 1;
+	while (power * 2 <= value) {
+		power *= 2;
+	}
+	return power;
+}
+
+void DepthPyramid::init(VulkanContext *context) {
+	this->context = context;
+
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+	if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr,
+									&descriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+	context->descriptorAllocator.allocate(MAX_PYRAMID_LEVELS, levelSets,
+										  descriptorSetLayout);
+
+	ComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.shaderPath = "../resources/spirv/depth_pyramid.comp.spv";
+	pipelineInfo.descriptorSetLayoutCount = 1;
+	pipelineInfo.pDescriptorSetLayouts = &descriptorSetLayout;
+	pipelineInfo.pushConstantSize = sizeof(PyramidPushConstants);
+	context->pipelines.createCompute(pipelineInfo, pipeline, pipelineLayout);
+
+	// NOTE: Levels are only ever fetched from
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	if (vkCreateSampler(context->device, &samplerInfo, nullptr, &sampler) !=
+		VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid sampler!");
+	}
+}
+
+void DepthPyramid::create(VkExtent2D extent, VkImageView depthView) {
+	width = previousPowerOfTwo(extent.width);
+	height = previousPowerOfTwo(extent.height);
+	levelCount = 1;
+	while ((width >> levelCount) > 0 || (height >> levelCount) > 0) {
+		levelCount++;
+	}
+	if (levelCount > MAX_PYRAMID_LEVELS) {
+		throw std::runtime_error("failed to fit the depth pyramid's levels!");
+	}
+
+	CreateImageInfo imageInfo{};
+	imageInfo.width = width;
+	imageInfo.height = height;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.layers = 1;
+	imageInfo.mipLevels = levelCount;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+					  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	imageInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(0);
+	context->createImage(imageInfo, image, allocation);
+
+	CreateImageViewInfo viewInfo{};
+	viewInfo.image = image;
+	viewInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.layers = 1;
+	viewInfo.mipLevels = levelCount;
+	context->createImageView(viewInfo, &view);
+
+	levelViews.resize(levelCount);
+	viewInfo.mipLevels = 1;
+	for (u32 level = 0; level < levelCount; level++) {
+		viewInfo.baseMipLevel = level;
+		context->createImageView(viewInfo, &levelViews[level]);
+	}
+
+	// Each level reduces the one before it, the first the depth attachment
+	for (u32 level = 0; level < levelCount; level++) {
+		VkDescriptorImageInfo sourceInfo{};
+		sourceInfo.sampler = sampler;
+		if (level == 0) {
+			sourceInfo.imageView = depthView;
+			sourceInfo.imageLayout =
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		} else {
+			sourceInfo.imageView = levelViews[level - 1];
+			sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+
+		VkDescriptorImageInfo destinationInfo{};
+		destinationInfo.imageView = levelViews[level];
+		destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet descriptorWrites[2]{};
+		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[0].dstSet = levelSets[level];
+		descriptorWrites[0].dstBinding = 0;
+		descriptorWrites[0].descriptorType =
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[0].descriptorCount = 1;
+		descriptorWrites[0].pImageInfo = &sourceInfo;
+		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[1].dstSet = levelSets[level];
+		descriptorWrites[1].dstBinding = 1;
+		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorWrites[1].descriptorCount = 1;
+		descriptorWrites[1].pImageInfo = &destinationInfo;
+		vkUpdateDescriptorSets(context->device, 2, descriptorWrites, 0,
+							   nullptr);
+	}
+
+	clear();
+}
+
+// Moves the new image to the general layout, at the far plane
+void DepthPyramid::clear() {
+	VkCommandBufferAllocateInfo allocateInfo{};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = context->drawCommandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(context->device, &allocateInfo,
+								 &commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate command buffer!");
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	VkImageSubresourceRange range{};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.levelCount = levelCount;
+	range.layerCount = 1;
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange = range;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+						 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+						 nullptr, 1, &barrier);
+
+	VkClearColorValue far = {{1.0f, 0.0f, 0.0f, 0.0f}};
+	vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &far,
+						 1, &range);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask =
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+						 0, nullptr, 1, &barrier);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
+
+	// NOTE: Only with the swap chain, waiting is fine
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	if (vkQueueSubmit(context->graphicsQueue, 1, &submitInfo,
+					  VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit command buffer!");
+	}
+	vkQueueWaitIdle(context->graphicsQueue);
+	vkFreeCommandBuffers(context->device, context->drawCommandPool, 1,
+						 &commandBuffer);
+}
+
+void DepthPyramid::record(VkCommandBuffer commandBuffer) {
+	// NOTE: This frame's culling pass read the levels about to be written
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+						 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	PyramidPushConstants constants{};
+	constants.sourceWidth = (i32)context->swapChainExtent.width;
+	constants.sourceHeight = (i32)context->swapChainExtent.height;
+	for (u32 level = 0; level < levelCount; level++) {
+		constants.width = (i32)std::max(width >> level, 1u);
+		constants.height = (i32)std::max(height >> level, 1u);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+								pipelineLayout, 0, 1, &levelSets[level], 0,
+								nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout,
+						   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+						   &constants);
+		vkCmdDispatch(commandBuffer,
+					  (constants.width + PYRAMID_WORKGROUP_SIZE - 1) /
+						  PYRAMID_WORKGROUP_SIZE,
+					  (constants.height + PYRAMID_WORKGROUP_SIZE - 1) /
+						  PYRAMID_WORKGROUP_SIZE,
+					  1);
+
+		// The next level reads this one, the next frame's culling all
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+							 &barrier, 0, nullptr, 0, nullptr);
+
+		constants.sourceWidth = constants.width;
+		constants.sourceHeight = constants.height;
+	}
+}
+
+void DepthPyramid::destroy() {
+	for (VkImageView levelView : levelViews) {
+		vkDestroyImageView(context->device, levelView, nullptr);
+	}
+	levelViews.clear();
+	vkDestroyImageView(context->device, view, nullptr);
+	vmaDestroyImage(context->allocator, image, allocation);
+}
+
+void DepthPyramid::cleanup() {
+	vkDestroySampler(context->device, sampler, nullptr);
+	vkDestroyPipeline(context->device, pipeline, nullptr);
+	vkDestroyPipelineLayout(context->device, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout,
+								 nullptr);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "glfw.h"
+#include <vma/vk_mem_alloc.h>
+
+#include <vector>
+
+struct VulkanContext;
+
+// Enough levels for a 32768 texel wide pyramid
+#define MAX_PYRAMID_LEVELS 16
+#define PYRAMID_WORKGROUP_SIZE 8
+
+// Must match depth_pyramid.comp
+struct PyramidPushConstants {
+	i32 sourceWidth;
+	i32 sourceHeight;
+	i32 width;
+	i32 height;
+};
+
+// Hierarchical depth of the last frame, built from the depth attachment once
+// the render pass ends. Each texel holds the farthest depth under it, level 0
+// is the swap chain extent rounded down to powers of two. Mesh instances
+// behind it are culled by the next frame's culling pass, see GpuCulling.
+//
+// The image stays in the general layout, and starts out cleared to the far
+// plane so nothing is occluded until a frame has built it.
+struct DepthPyramid {
+	VkImage image;
+	VmaAllocation allocation;
+	VkImageView view; // Every level, sampled by the culling pass
+	VkSampler sampler;
+	u32 width, height;
+	u32 levelCount;
+
+	void init(VulkanContext *context);
+
+	// With the swap chain, `depthView` is the depth attachment's
+	void create(VkExtent2D extent, VkImageView depthView);
+	void destroy();
+
+	// After the render pass, the depth attachment being read only
+	void record(VkCommandBuffer commandBuffer);
+
+	void cleanup();
+
+  private:
+	VulkanContext *context;
+
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSet levelSets[MAX_PYRAMID_LEVELS]; // Rewritten by create
+	std::vector<VkImageView> levelViews;
+
+	void clear();
+};
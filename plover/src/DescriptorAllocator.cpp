@@ -62,13 +62,17 @@ VkDescriptorPool DescriptorAllocator::getPool() {
     else {
         VkDescriptorPool pool{};
 
-        std::array<VkDescriptorPoolSize, 3> poolSizes{};
+        std::array<VkDescriptorPoolSize, 5> poolSizes{};
         poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         poolSizes[0].descriptorCount = static_cast<uint32_t>(DEFAULT_DESCRIPTOR_POOL_SIZE);
         poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         poolSizes[1].descriptorCount = static_cast<uint32_t>(DEFAULT_DESCRIPTOR_POOL_SIZE);
         poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         poolSizes[2].descriptorCount = static_cast<uint32_t>(DEFAULT_DESCRIPTOR_POOL_SIZE);
+        poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[3].descriptorCount = static_cast<uint32_t>(DEFAULT_DESCRIPTOR_POOL_SIZE);
+        poolSizes[4].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        poolSizes[4].descriptorCount = static_cast<uint32_t>(DEFAULT_DESCRIPTOR_POOL_SIZE);
 
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
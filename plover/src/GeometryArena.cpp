@@ -0,0 +1,125 @@
+#include "GeometryArena.h"
+#include "VulkanContext.h"
+
+#include <stdexcept>
+
+void RangeAllocator::init(VkDeviceSize size) {
+	ranges.clear();
+	ranges[0] = size;
+	freeSize = size;
+}
+
+bool RangeAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment,
+							  VkDeviceSize *offset) {
+	for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+		VkDeviceSize start = it->first;
+		VkDeviceSize rangeSize = it->second;
+		// NOTE: Vertex strides aren't powers of two
+		VkDeviceSize aligned = (start + alignment - 1) / alignment * alignment;
+		VkDeviceSize padding = aligned - start;
+		if (padding + size > rangeSize) {
+			continue;
+		}
+
+		ranges.erase(it);
+		if (padding > 0) {
+			ranges[start] = padding;
+		}
+		VkDeviceSize remaining = rangeSize - padding - size;
+		if (remaining > 0) {
+			ranges[aligned + size] = remaining;
+		}
+		freeSize -= size;
+		*offset = aligned;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::free(VkDeviceSize offset, VkDeviceSize size) {
+	auto it = ranges.insert({offset, size}).first;
+	freeSize += size;
+
+	auto next = std::next(it);
+	if (next != ranges.end() && offset + it->second == next->first) {
+		it->second += next->second;
+		ranges.erase(next);
+	}
+	if (it != ranges.begin()) {
+		auto previous = std::prev(it);
+		if (previous->first + previous->second == offset) {
+			previous->second += it->second;
+			ranges.erase(it);
+		}
+	}
+}
+
+void GeometryArena::init(VulkanContext *context) {
+	this->context = context;
+
+	CreateBufferInfo vertexCreateInfo{};
+	vertexCreateInfo.size = GEOMETRY_VERTEX_ARENA_SIZE;
+	vertexCreateInfo.usage =
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	vertexCreateInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	vertexCreateInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(0);
+	context->createBuffer(vertexCreateInfo, vertexBuffer, vertexAllocation);
+
+	CreateBufferInfo indexCreateInfo{};
+	indexCreateInfo.size = GEOMETRY_INDEX_ARENA_SIZE;
+	indexCreateInfo.usage =
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	indexCreateInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	indexCreateInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(0);
+	context->createBuffer(indexCreateInfo, indexBuffer, indexAllocation);
+
+	vertices.init(GEOMETRY_VERTEX_ARENA_SIZE);
+	indices.init(GEOMETRY_INDEX_ARENA_SIZE);
+}
+
+GeometryRange GeometryArena::allocateVertices(u64 vertexCount) {
+	GeometryRange range{0, vertexCount * sizeof(PackedVertex)};
+	if (range.size == 0) {
+		return range;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!vertices.allocate(range.size, sizeof(PackedVertex), &range.offset)) {
+		throw std::runtime_error("failed to allocate vertices in arena!");
+	}
+	return range;
+}
+
+GeometryRange GeometryArena::allocateIndices(u64 indexCount, u32 indexSize) {
+	GeometryRange range{0, indexCount * indexSize};
+	if (range.size == 0) {
+		return range;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!indices.allocate(range.size, indexSize, &range.offset)) {
+		throw std::runtime_error("failed to allocate indices in arena!");
+	}
+	return range;
+}
+
+void GeometryArena::freeVertices(GeometryRange range) {
+	if (range.size == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	vertices.free(range.offset, range.size);
+}
+
+void GeometryArena::freeIndices(GeometryRange range) {
+	if (range.size == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	indices.free(range.offset, range.size);
+}
+
+void GeometryArena::cleanup() {
+	vmaDestroyBuffer(context->allocator, vertexBuffer, vertexAllocation);
+	vmaDestroyBuffer(context->allocator, indexBuffer, indexAllocation);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "glfw.h"
+#include <vma/vk_mem_alloc.h>
+
+#include <map>
+#include <mutex>
+
+struct VulkanContext;
+
+#define GEOMETRY_VERTEX_ARENA_SIZE (128ull * 1024 * 1024)
+#define GEOMETRY_INDEX_ARENA_SIZE (64ull * 1024 * 1024)
+
+// Bytes of one of the arena's buffers
+struct GeometryRange {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+};
+
+// First fit free list over a fixed size, merging neighbouring free ranges
+// back together as they are freed.
+struct RangeAllocator {
+	void init(VkDeviceSize size);
+	// Returns false when no free range is large enough
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment,
+				  VkDeviceSize *offset);
+	void free(VkDeviceSize offset, VkDeviceSize size);
+
+	VkDeviceSize available() const { return freeSize; }
+
+  private:
+	std::map<VkDeviceSize, VkDeviceSize> ranges; // Free, size by offset
+	VkDeviceSize freeSize;
+};
+
+// One device local vertex buffer and one index buffer every model is
+// sub-allocated from, so drawing never rebinds geometry. Vertices are aligned
+// to whole vertices and indices to their size, which lets draws address them
+// by vertexOffset and firstIndex.
+//
+// Safe to use from any thread.
+struct GeometryArena {
+	VkBuffer vertexBuffer;
+	VmaAllocation vertexAllocation;
+
+	// Holds 16 and 32 bit indices, bound once per index type
+	VkBuffer indexBuffer;
+	VmaAllocation indexAllocation;
+
+	void init(VulkanContext *context);
+
+	GeometryRange allocateVertices(u64 vertexCount);
+	GeometryRange allocateIndices(u64 indexCount, u32 indexSize);
+	// NOTE: Frames in flight must be done drawing from the range
+	void freeVertices(GeometryRange range);
+	void freeIndices(GeometryRange range);
+
+	void cleanup();
+
+  private:
+	VulkanContext *context;
+	std::mutex mutex;
+	RangeAllocator vertices;
+	RangeAllocator indices;
+};
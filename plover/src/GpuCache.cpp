@@ -0,0 +1,130 @@
+#include "GpuCache.h"
+#include "VulkanContext.h"
+
+#include <stdexcept>
+
+void GpuCache::init(VulkanContext *context) {
+	this->context = context;
+	budget = defaultCacheBudget(*context);
+	frame = 0;
+	resident = 0;
+}
+
+bool GpuCache::contains(CacheKey key) const {
+	return entries.count(key) != 0;
+}
+
+GpuCache::CacheEntry &GpuCache::acquire(CacheKey key, AssetType type) {
+	auto it = entries.find(key);
+	if (it == entries.end() || it->second.type != type) {
+		throw std::runtime_error("failed to find cached asset!");
+	}
+
+	CacheEntry &entry = it->second;
+	if (entry.references == 0) {
+		unused.erase(entry.unusedPosition);
+	}
+	entry.references++;
+	return entry;
+}
+
+const CachedModel &GpuCache::acquireModel(u64 id) {
+	return acquire({id}, MODEL).model;
+}
+
+const Texture &GpuCache::acquireTexture(u64 id, bool srgb) {
+	return acquire({id, srgb}, IMAGE).texture;
+}
+
+void GpuCache::release(CacheKey key) {
+	CacheEntry &entry = entries.at(key);
+	assert(entry.references > 0 && "Released an unreferenced asset!");
+
+	entry.references--;
+	if (entry.references == 0) {
+		entry.lastUsed = frame;
+		entry.unusedPosition = unused.insert(unused.end(), key);
+	}
+}
+
+void GpuCache::add(CacheKey key, CacheEntry entry) {
+	assert(!contains(key) && "Asset uploaded twice!");
+
+	entry.references = 0;
+	entry.lastUsed = frame;
+	entry.unusedPosition = unused.insert(unused.end(), key);
+	resident += entry.size;
+	entries[key] = entry;
+}
+
+void GpuCache::addModel(u64 id, const CachedModel &model) {
+	CacheEntry entry{};
+	entry.type = MODEL;
+	entry.size = model.vertices.size + model.indices.size;
+	entry.model = model;
+	add({id}, entry);
+}
+
+void GpuCache::addTexture(u64 id, bool srgb, const Texture &texture) {
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(context->allocator, texture.allocation, &info);
+
+	CacheEntry entry{};
+	entry.type = IMAGE;
+	entry.size = info.size;
+	entry.texture = texture;
+	entry.texture.tableSlot = context->materialTable.addTexture(texture);
+	add({id, srgb}, entry);
+}
+
+void GpuCache::destroy(CacheEntry &entry) {
+	if (entry.type == MODEL) {
+		context->geometry.freeVertices(entry.model.vertices);
+		context->geometry.freeIndices(entry.model.indices);
+	} else {
+		context->materialTable.removeTexture(entry.texture.tableSlot);
+		entry.texture.cleanup(*context);
+	}
+	resident -= entry.size;
+}
+
+void GpuCache::update() {
+	frame++;
+
+	// NOTE: Frames still in flight may have drawn with an entry released
+	// since, so it has to sit out MAX_FRAMES_IN_FLIGHT frames first. Released
+	// entries go to the back, so the front is always the oldest.
+	while (resident > budget && !unused.empty()) {
+		CacheKey key = unused.front();
+		CacheEntry &entry = entries.at(key);
+		if (frame - entry.lastUsed <= MAX_FRAMES_IN_FLIGHT) {
+			break;
+		}
+
+		destroy(entry);
+		unused.pop_front();
+		entries.erase(key);
+	}
+}
+
+void GpuCache::cleanup() {
+	for (auto &kv : entries) {
+		destroy(kv.second);
+	}
+	entries.clear();
+	unused.clear();
+}
+
+u64 defaultCacheBudget(VulkanContext &context) {
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(context.allocator, budgets);
+
+	u64 deviceLocal = 0;
+	for (u32 i = 0; i < context.deviceMemoryProperties.memoryHeapCount; i++) {
+		if (context.deviceMemoryProperties.memoryHeaps[i].flags &
+			VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			deviceLocal += budgets[i].budget;
+		}
+	}
+	return deviceLocal / 2;
+}
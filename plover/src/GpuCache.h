@@ -0,0 +1,93 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "GeometryArena.h"
+#include "Texture.h"
+
+#include <vma/vk_mem_alloc.h>
+#include <list>
+#include <unordered_map>
+
+struct VulkanContext;
+
+// Vertices and indices of a model in the geometry arena, shared by every
+// mesh drawing it
+struct CachedModel {
+	ModelMetadata metadata;
+
+	GeometryRange vertices;
+	GeometryRange indices;
+
+	// Bounding sphere of the unorm positions, center then radius
+	glm::vec4 bounds;
+};
+
+// An asset as uploaded. The same image can be sampled as sRGB or linear, each
+// is a resource of its own.
+struct CacheKey {
+	u64 id;
+	bool srgb = false; // Images only
+
+	bool operator==(const CacheKey &other) const = default;
+};
+
+struct CacheKeyHash {
+	// NOTE: Asset IDs are already hashes
+	size_t operator()(const CacheKey &key) const {
+		return (size_t)(key.id ^ (u64)key.srgb);
+	}
+};
+
+// Device resources uploaded from the pack, keyed by asset ID and format.
+// Meshes and materials hold references to them. Unreferenced resources stay
+// resident so they can be picked up again for free, until the cache grows past
+// its budget and the least recently used ones are evicted.
+// NOTE: Main thread only
+struct GpuCache {
+	u64 budget; // Bytes of device memory
+	u64 frame;	// Incremented by update
+
+	void init(VulkanContext *context);
+
+	bool contains(CacheKey key) const;
+	// Take a reference to a resident resource
+	const CachedModel &acquireModel(u64 id);
+	const Texture &acquireTexture(u64 id, bool srgb);
+	void release(CacheKey key);
+
+	// Take ownership of a freshly uploaded resource, with no references
+	void addModel(u64 id, const CachedModel &model);
+	void addTexture(u64 id, bool srgb, const Texture &texture);
+
+	// Once per frame, evicts unreferenced resources while over budget
+	void update();
+	void cleanup();
+
+	u64 residentSize() const { return resident; }
+
+  private:
+	struct CacheEntry {
+		AssetType type;
+		u32 references;
+		u64 size;
+		u64 lastUsed; // Frame the entry was added or last released
+		std::list<CacheKey>::iterator unusedPosition;
+
+		CachedModel model;
+		Texture texture;
+	};
+
+	VulkanContext *context;
+	std::unordered_map<CacheKey, CacheEntry, CacheKeyHash> entries;
+	// Unreferenced entries, least recently used first
+	std::list<CacheKey> unused;
+	u64 resident;
+
+	CacheEntry &acquire(CacheKey key, AssetType type);
+	void add(CacheKey key, CacheEntry entry);
+	void destroy(CacheEntry &entry);
+};
+
+// Half of what VMA reports as the device local heaps' budget
+u64 defaultCacheBudget(VulkanContext &context);
@@ -0,0 +1,224 @@
+#include "GpuCulling.h"
+#include "DepthPyramid.h"
+#include "VulkanContext.h"
+
+#include <stdexcept>
+
+void GpuCulling::createFrameBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+								   bool hostWritten, FrameBuffer &buffer) {
+	CreateBufferInfo createInfo{};
+	createInfo.size = size;
+	createInfo.usage = usage;
+	if (hostWritten) {
+		createInfo.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+								VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		createInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+			VMA_ALLOCATION_CREATE_MAPPED_BIT);
+	} else {
+		createInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		createInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(0);
+	}
+	context->createBuffer(createInfo, buffer.buffer, buffer.allocation);
+
+	buffer.mapped = nullptr;
+	if (hostWritten) {
+		VmaAllocationInfo allocInfo = {};
+		vmaGetAllocationInfo(context->allocator, buffer.allocation,
+							 &allocInfo);
+		buffer.mapped = allocInfo.pMappedData;
+	}
+}
+
+void GpuCulling::init(VulkanContext *context) {
+	this->context = context;
+
+	VkDescriptorSetLayoutBinding bindings[9]{};
+	for (u32 i = 0; i < 9; i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	// Written by bindPyramid
+	bindings[8].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 9;
+	layoutInfo.pBindings = bindings;
+	if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr,
+									&descriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+
+	pipeline = VK_NULL_HANDLE;
+	pipelineLayout = VK_NULL_HANDLE;
+	if (!onHost) {
+		ComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.shaderPath = "../resources/spirv/cull.comp.spv";
+		pipelineInfo.descriptorSetLayoutCount = 1;
+		pipelineInfo.pDescriptorSetLayouts = &descriptorSetLayout;
+		pipelineInfo.pushConstantSize = sizeof(CullPushConstants);
+		context->pipelines.createCompute(pipelineInfo, pipeline,
+										 pipelineLayout);
+	}
+
+	frames.resize(MAX_FRAMES_IN_FLIGHT);
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		CullFrame &frame = frames[i];
+		createFrameBuffer(MAX_MESH_DRAWS * sizeof(CullDraw),
+						  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true,
+						  frame.draws);
+		createFrameBuffer(MAX_MESH_INSTANCES * sizeof(u32),
+						  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true,
+						  frame.instanceDraws);
+		createFrameBuffer(MAX_MESH_INSTANCES * sizeof(u32),
+						  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, onHost,
+						  frame.visible);
+		createFrameBuffer(2 * MAX_MESH_DRAWS * sizeof(u32),
+						  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+							  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+							  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+						  false, frame.counts);
+		createFrameBuffer(MAX_MESH_DRAWS * sizeof(VkDrawIndexedIndirectCommand),
+						  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+							  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+						  onHost, frame.output);
+
+		context->descriptorAllocator.allocate(1, &frame.descriptorSet,
+											  descriptorSetLayout);
+
+		VkDescriptorBufferInfo bufferInfos[8]{};
+		bufferInfos[0] = context->uniforms.descriptor(sizeof(GlobalUniform));
+		bufferInfos[1].buffer = context->meshInstanceBuffers[i];
+		bufferInfos[2].buffer = frame.instanceDraws.buffer;
+		bufferInfos[3].buffer = frame.draws.buffer;
+		bufferInfos[4].buffer = context->indirectBuffers[i];
+		bufferInfos[4].range = UI_DRAW_OFFSET;
+		bufferInfos[5].buffer = frame.counts.buffer;
+		bufferInfos[6].buffer = frame.visible.buffer;
+		bufferInfos[7].buffer = frame.output.buffer;
+
+		VkWriteDescriptorSet descriptorWrites[8]{};
+		for (u32 binding = 0; binding < 8; binding++) {
+			if (bufferInfos[binding].range == 0) {
+				bufferInfos[binding].range = VK_WHOLE_SIZE;
+			}
+
+			VkWriteDescriptorSet &descriptorWrite = descriptorWrites[binding];
+			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrite.dstSet = frame.descriptorSet;
+			descriptorWrite.dstBinding = binding;
+			descriptorWrite.dstArrayElement = 0;
+			descriptorWrite.descriptorType = bindings[binding].descriptorType;
+			descriptorWrite.descriptorCount = 1;
+			descriptorWrite.pBufferInfo = &bufferInfos[binding];
+		}
+		vkUpdateDescriptorSets(context->device, 8, descriptorWrites, 0,
+							   nullptr);
+	}
+}
+
+void GpuCulling::record(VkCommandBuffer commandBuffer, u32 frame,
+						u32 drawCount, u32 instanceCount) {
+	CullFrame &cullFrame = frames[frame];
+
+	vkCmdFillBuffer(commandBuffer, cullFrame.counts.buffer, 0, VK_WHOLE_SIZE,
+					0);
+
+	// NOTE: The depth pyramid was last built by the previous submission
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask =
+		VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask =
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+						 VK_PIPELINE_STAGE_TRANSFER_BIT |
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+						 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+							pipelineLayout, 0, 1, &cullFrame.descriptorSet, 1,
+							&context->globalUniformOffset);
+
+	CullPushConstants constants{};
+	constants.instanceCount = instanceCount;
+	constants.drawCount = drawCount;
+	constants.pass = 0;
+	constants.compact = drawIndirectCount;
+	constants.batchCountsOffset = MAX_MESH_DRAWS;
+	vkCmdPushConstants(commandBuffer, pipelineLayout,
+					   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+					   &constants);
+	vkCmdDispatch(commandBuffer,
+				  (instanceCount + CULL_WORKGROUP_SIZE - 1) /
+					  CULL_WORKGROUP_SIZE,
+				  1, 1);
+
+	// Draws need every instance counted
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask =
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+						 0, nullptr, 0, nullptr);
+
+	constants.pass = 1;
+	vkCmdPushConstants(commandBuffer, pipelineLayout,
+					   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+					   &constants);
+	vkCmdDispatch(commandBuffer,
+				  (drawCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE,
+				  1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask =
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+							 VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCulling::bindPyramid(const DepthPyramid &pyramid) {
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.sampler = pyramid.sampler;
+	imageInfo.imageView = pyramid.view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	for (CullFrame &frame : frames) {
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = frame.descriptorSet;
+		descriptorWrite.dstBinding = 8;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType =
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(context->device, 1, &descriptorWrite, 0,
+							   nullptr);
+	}
+}
+
+void GpuCulling::cleanup() {
+	for (CullFrame &frame : frames) {
+		for (FrameBuffer *buffer : {&frame.draws, &frame.instanceDraws,
+									&frame.visible, &frame.counts,
+									&frame.output}) {
+			vmaDestroyBuffer(context->allocator, buffer->buffer,
+							 buffer->allocation);
+		}
+	}
+	frames.clear();
+
+	vkDestroyPipeline(context->device, pipeline, nullptr);
+	vkDestroyPipelineLayout(context->device, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout,
+								 nullptr);
+}
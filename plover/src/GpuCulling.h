@@ -0,0 +1,87 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "glfw.h"
+#include <vma/vk_mem_alloc.h>
+
+#include <vector>
+
+struct VulkanContext;
+struct DepthPyramid;
+
+#define CULL_WORKGROUP_SIZE 64
+
+// Per draw input of the culling pass
+struct CullDraw {
+	glm::vec4 sphere; // Around the draw's unorm positions, see Mesh::bounds
+	u32 batch;
+	u32 firstOutput; // First command of its batch
+	u32 padding[2];
+};
+
+// Must match cull.comp
+struct CullPushConstants {
+	u32 instanceCount;
+	u32 drawCount;
+	u32 pass; // Instances, then draws
+	u32 compact;
+	u32 batchCountsOffset;
+};
+
+// Tests every mesh instance against the camera frustum in a compute pass
+// before the frame's draws. The first pass keeps the visible instances and
+// counts them per draw, the second writes each draw's command with its
+// visible instance count. Where vkCmdDrawIndexedIndirectCount is supported,
+// draws left without instances are dropped and the survivors compacted per
+// batch, counted for the draw to read.
+//
+// Instances behind the last frame's depth pyramid are culled as well, tested
+// with the camera it was built with. Anything the camera uncovers since pops
+// in one frame late.
+struct GpuCulling {
+	bool drawIndirectCount;
+	// Software devices cull on the host instead, see
+	// VulkanContext::cullOnHost. No pass is recorded, the visible instances
+	// and commands are host written.
+	bool onHost;
+
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+
+	struct FrameBuffer {
+		VkBuffer buffer;
+		VmaAllocation allocation;
+		void *mapped; // Host written buffers only
+	};
+
+	// Per frame
+	struct CullFrame {
+		FrameBuffer draws;		   // CullDraw per draw, written with commands
+		FrameBuffer instanceDraws; // Draw of each instance, u32
+		FrameBuffer visible;	   // Visible instances by draw, u32
+		// Visible instances per draw, then surviving draws per batch
+		FrameBuffer counts;
+		FrameBuffer output; // Culled draw commands
+		VkDescriptorSet descriptorSet;
+	};
+	std::vector<CullFrame> frames;
+
+	// After the frame's instance, indirect and uniform buffers exist
+	void init(VulkanContext *context);
+
+	// Outside of the render pass
+	void record(VkCommandBuffer commandBuffer, u32 frame, u32 drawCount,
+				u32 instanceCount);
+	// Whenever the pyramid is created again
+	void bindPyramid(const DepthPyramid &pyramid);
+
+	void cleanup();
+
+  private:
+	VulkanContext *context;
+
+	void createFrameBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+						   bool hostWritten, FrameBuffer &buffer);
+};
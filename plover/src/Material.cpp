@@ -1,90 +1,16 @@
 #include "Material.h"
 #include "VulkanContext.h"
 
-void Material::createDescriptorSets(VulkanContext& context) {
-	descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-	context.descriptorAllocator.allocate(MAX_FRAMES_IN_FLIGHT, descriptorSets.data(), context.materialDescriptorSetLayout);
-
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		VkDescriptorImageInfo texInfo{};
-		texInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		texInfo.imageView = texture.imageView;
-		texInfo.sampler = texture.sampler;
-
-		VkDescriptorImageInfo nrmInfo{};
-		nrmInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		nrmInfo.imageView = normalTexture.imageView;
-		nrmInfo.sampler = normalTexture.sampler;
-
-		VkWriteDescriptorSet descriptorWrites[2];
-		descriptorWrites[0] = {};
-		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[0].dstSet = descriptorSets[i];
-		descriptorWrites[0].dstBinding = 0;
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pImageInfo = &texInfo;
-
-		descriptorWrites[1] = {};
-		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[1].dstSet = descriptorSets[i];
-		descriptorWrites[1].dstBinding = 1;
-		descriptorWrites[1].dstArrayElement = 0;
-		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[1].descriptorCount = 1;
-		descriptorWrites[1].pImageInfo = &nrmInfo;
-
-		vkUpdateDescriptorSets(context.device, 2, descriptorWrites, 0, nullptr);
-	}
-}
-
 void Material::cleanup(VulkanContext& context) {
-	vkDestroyPipeline(context.device, pipeline, nullptr);
-	vkDestroyPipelineLayout(context.device, pipelineLayout, nullptr);
-
-	texture.cleanup(context);
-	normalTexture.cleanup(context);
-}
-
-void createMaterialDescriptorSetLayout(VulkanContext& context) {
-	VkDescriptorSetLayoutBinding layoutBindings[2];
-	layoutBindings[0].binding = 0;
-	layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	layoutBindings[0].descriptorCount = 1;
-	layoutBindings[0].pImmutableSamplers = nullptr;
-	layoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-	layoutBindings[1].binding = 1;
-	layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	layoutBindings[1].descriptorCount = 1;
-	layoutBindings[1].pImmutableSamplers = nullptr;
-	layoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-	VkDescriptorSetLayoutCreateInfo layoutInfo{};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = 2;
-	layoutInfo.pBindings = layoutBindings;
-
-	if (vkCreateDescriptorSetLayout(context.device,
-									&layoutInfo,
-									nullptr,
-									&context.materialDescriptorSetLayout) != VK_SUCCESS) {
-		throw std::runtime_error("falied to create descriptor set layout!");
-	}
+	context.pipelines.release(pipeline);
 }
 
 global_var size_t nextId = 1;
 
-size_t createMaterial(VulkanContext& context,
-					  AssetLoader loader,
-					  const char *texturePath,
-					  const char *normalPath) {
-	Material material{};
-
+void createMaterialPipeline(VulkanContext& context, Material& material) {
 	VkDescriptorSetLayout descriptorSetLayouts[3] = {
 		context.globalDescriptorSetLayout,
-		context.materialDescriptorSetLayout,
+		context.materialTable.descriptorSetLayout,
 		context.meshDescriptorSetLayout
 	};
 
@@ -105,14 +31,18 @@ size_t createMaterial(VulkanContext& context,
 	createInfo.attributeDescriptionCount = attributeDescriptions.size();
 	createInfo.pAttributeDescriptions = attributeDescriptions.data();
 
-	context.createGraphicsPipeline(createInfo, material.pipeline, material.pipelineLayout);
+	// NOTE: Every material shares this pipeline, instances pick theirs from
+	// the material table
+	context.pipelines.create(createInfo, material.pipeline, material.pipelineLayout);
+}
 
-	createImageTexture(context, loader, material.texture, texturePath, SRGBA8);
-	createImageTexture(context, loader, material.normalTexture, normalPath, RGBA8);
-	material.createDescriptorSets(context);
+size_t addMaterial(VulkanContext& context, Material& material) {
+	material.index = context.materialTable.addMaterial(material.texture,
+														material.normal);
 
 	size_t id = nextId;
 	context.materials[id] = material;
+	context.sceneVersion++;
 	nextId++;
 
 	return id;
@@ -13,13 +13,19 @@ struct Material {
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
 
-	Texture texture;
-	Texture normalTexture;
-	std::vector<VkDescriptorSet> descriptorSets;
+	// Both belong to the cache
+	u64 textureID;
+	u64 normalID;
+	// Their slots in the material table
+	u32 texture;
+	u32 normal;
+	u32 index; // In the material table, from addMaterial
 
-	void createDescriptorSets(VulkanContext& context);
 	void cleanup(VulkanContext& context);
 };
 
-size_t createMaterial(VulkanContext& context, AssetLoader loader, const char *texturePath, const char *normalPath);
-void createMaterialDescriptorSetLayout(VulkanContext& context);
+// Safe to call from any thread
+void createMaterialPipeline(VulkanContext& context, Material& material);
+// Gives a material whose pipeline and textures are ready its entry in the
+// material table and an ID. Main thread only.
+size_t addMaterial(VulkanContext& context, Material& material);
@@ -0,0 +1,191 @@
+#include "MaterialTable.h"
+#include "Texture.h"
+#include "VulkanContext.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void MaterialTable::init(VulkanContext *context) {
+	this->context = context;
+
+	VkPhysicalDeviceVulkan12Properties properties12{};
+	properties12.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties2{};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &properties12;
+	vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties2);
+	textureCapacity = std::min(
+		{(u32)MAX_TABLE_TEXTURES,
+		 properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		 properties12.maxDescriptorSetUpdateAfterBindSampledImages});
+	textureCount = 0;
+
+	// Shared by every texture, their mip levels are clamped by their views
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(context->physicalDevice, &supportedFeatures);
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	if (supportedFeatures.samplerAnisotropy == VK_TRUE) {
+		samplerInfo.anisotropyEnable = VK_TRUE;
+		samplerInfo.maxAnisotropy =
+			properties2.properties.limits.maxSamplerAnisotropy;
+	}
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	if (vkCreateSampler(context->device, &samplerInfo, nullptr, &sampler) !=
+		VK_SUCCESS) {
+		throw std::runtime_error("failed to create texture sampler!");
+	}
+
+	VkDescriptorSetLayoutBinding bindings[3]{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[1].pImmutableSamplers = &sampler;
+	bindings[2].binding = 2;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	bindings[2].descriptorCount = textureCapacity;
+	bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	// NOTE: Free slots are never sampled, their images may be long gone
+	VkDescriptorBindingFlags bindingFlags[3] = {
+		0, 0,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT};
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+	bindingFlagsInfo.sType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.bindingCount = 3;
+	bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &bindingFlagsInfo;
+	layoutInfo.flags =
+		VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = 3;
+	layoutInfo.pBindings = bindings;
+	if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr,
+									&descriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+
+	// NOTE: Update after bind sets need a pool of their own
+	VkDescriptorPoolSize poolSizes[3]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+	poolSizes[1].descriptorCount = 1;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	poolSizes[2].descriptorCount = textureCapacity;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+	if (vkCreateDescriptorPool(context->device, &poolInfo, nullptr, &pool) !=
+		VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo allocateInfo{};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = pool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &descriptorSetLayout;
+	if (vkAllocateDescriptorSets(context->device, &allocateInfo,
+								 &descriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor sets!");
+	}
+
+	// NOTE: Materials are only ever appended, so entries a frame in flight
+	// reads are never written again
+	CreateBufferInfo createInfo{};
+	createInfo.size = MAX_MATERIALS * sizeof(GpuMaterial);
+	createInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	createInfo.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+							VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	createInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+		VMA_ALLOCATION_CREATE_MAPPED_BIT);
+	context->createBuffer(createInfo, materialBuffer, materialAllocation);
+	VmaAllocationInfo allocInfo = {};
+	vmaGetAllocationInfo(context->allocator, materialAllocation, &allocInfo);
+	materials = (GpuMaterial *)allocInfo.pMappedData;
+	materialCount = 0;
+
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = materialBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet descriptorWrite{};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+	vkUpdateDescriptorSets(context->device, 1, &descriptorWrite, 0, nullptr);
+}
+
+u32 MaterialTable::addTexture(const Texture &texture) {
+	u32 slot;
+	if (!freeTextures.empty()) {
+		slot = freeTextures.back();
+		freeTextures.pop_back();
+	} else if (textureCount < textureCapacity) {
+		slot = textureCount++;
+	} else {
+		throw std::runtime_error("failed to find a free texture slot!");
+	}
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageView = texture.imageView;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet descriptorWrite{};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstBinding = 2;
+	descriptorWrite.dstArrayElement = slot;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(context->device, 1, &descriptorWrite, 0, nullptr);
+
+	return slot;
+}
+
+void MaterialTable::removeTexture(u32 slot) { freeTextures.push_back(slot); }
+
+u32 MaterialTable::addMaterial(u32 texture, u32 normal) {
+	if (materialCount == MAX_MATERIALS) {
+		throw std::runtime_error("failed to add material, the table is full!");
+	}
+
+	materials[materialCount] = {texture, normal};
+	return materialCount++;
+}
+
+void MaterialTable::cleanup() {
+	vmaDestroyBuffer(context->allocator, materialBuffer, materialAllocation);
+	vkDestroyDescriptorPool(context->device, pool, nullptr);
+	vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout, nullptr);
+	vkDestroySampler(context->device, sampler, nullptr);
+}
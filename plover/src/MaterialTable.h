@@ -0,0 +1,62 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "glfw.h"
+#include <vma/vk_mem_alloc.h>
+
+#include <vector>
+
+struct VulkanContext;
+struct Texture;
+
+// Clamped to the device's update after bind limits
+#define MAX_TABLE_TEXTURES 4096
+#define MAX_MATERIALS 4096
+
+// Must match shader.frag and raycaster.frag
+struct GpuMaterial {
+	u32 texture; // Slots in the table
+	u32 normal;
+};
+
+// Every texture and material drawn with, in one descriptor set bound once per
+// pipeline layout. Textures sit in a partially bound array of sampled images,
+// all read through one sampler, and materials in a storage buffer of texture
+// slots that mesh instances and raycaster voxels index. Slots are written
+// after the set is bound, so adding a texture or a material never touches a
+// set a frame in flight uses.
+//
+// Bindings: 0 the materials, 1 the sampler, 2 the textures.
+// NOTE: Main thread only
+struct MaterialTable {
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorSet descriptorSet;
+
+	// Once the device and the allocator exist
+	void init(VulkanContext *context);
+
+	// Slot of a texture in shader read only layout, until removed
+	u32 addTexture(const Texture &texture);
+	// Once no frame in flight samples it anymore
+	void removeTexture(u32 slot);
+	// Index of a material sampling the given texture slots
+	u32 addMaterial(u32 texture, u32 normal);
+	u32 count() const { return materialCount; }
+
+	void cleanup();
+
+  private:
+	VulkanContext *context;
+
+	VkDescriptorPool pool;
+	VkSampler sampler;
+	VkBuffer materialBuffer;
+	VmaAllocation materialAllocation;
+	GpuMaterial *materials; // Mapped
+	u32 materialCount;
+
+	u32 textureCapacity;
+	u32 textureCount; // Slots ever handed out
+	std::vector<u32> freeTextures;
+};
@@ -2,27 +2,22 @@
 #include <plover/plover.h>
 
 #include "Texture.h"
+#include "GpuCache.h"
 
 #include <vma/vk_mem_alloc.h>
 #include "glfw.h"
 #include <array>
+#include <span>
 
 struct VulkanContext;
 
-struct Vertex {
-	glm::vec3 pos;
-	glm::vec3 normal;
-	glm::vec3 tangent;
-	glm::vec2 texCoord;
-
-	bool operator==(const Vertex& other) const {
-		return pos == other.pos && normal == other.normal && texCoord == other.texCoord;
-	}
-
+// Quantized layout written by lapwing, see PackedVertex. Positions need the
+// mesh's dequantization transform, normals and tangents are octahedral.
+struct Vertex : PackedVertex {
 	static VkVertexInputBindingDescription getBindingDescription() {
 		VkVertexInputBindingDescription bindingDescription{};
 		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
+		bindingDescription.stride = sizeof(PackedVertex);
 		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		return bindingDescription;
@@ -32,76 +27,67 @@ struct Vertex {
 		std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
 		attributeDescriptions[0].binding = 0;
 		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
+		attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
 
 		attributeDescriptions[1].binding = 0;
 		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, normal);
+		attributeDescriptions[1].format = VK_FORMAT_R16G16_SNORM;
+		attributeDescriptions[1].offset = offsetof(PackedVertex, normal);
 
 		attributeDescriptions[2].binding = 0;
 		attributeDescriptions[2].location = 2;
-		attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[2].offset = offsetof(Vertex, tangent);
+		attributeDescriptions[2].format = VK_FORMAT_R16G16_SNORM;
+		attributeDescriptions[2].offset = offsetof(PackedVertex, tangent);
 
 		attributeDescriptions[3].binding = 0;
 		attributeDescriptions[3].location = 3;
-		attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescriptions[3].offset = offsetof(Vertex, texCoord);
+		attributeDescriptions[3].format = VK_FORMAT_R16G16_SFLOAT;
+		attributeDescriptions[3].offset = offsetof(PackedVertex, texCoord);
 
 		return attributeDescriptions;
 	}
 };
 
-struct MeshUniform {
+static_assert(sizeof(Vertex) == sizeof(PackedVertex));
+
+// Per instance data, indexed by gl_InstanceIndex. Must match shader.vert.
+struct MeshInstance {
 	glm::mat4 model;
+	u32 material; // In the material table
+	u32 padding[3];
 };
 
 struct Mesh {
-	Vertex* vertices;
+	u64 modelID;
 	u64 vertexCount;
-	uint32_t* indices;
 	u64 indexCount;
+	VkIndexType indexType;
 
-	VkBuffer vertexBuffer;
-	VmaAllocation vertexAllocation;
-
-	VkBuffer indexBuffer;
-	VmaAllocation indexAllocation;
+	// Into the geometry arena, shared with every mesh of the same model
+	i32 vertexOffset;
+	u32 firstIndex;
 
 	glm::mat4 transform;
-
-	std::vector<VkDescriptorSet> uniformDescriptorSets;
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VmaAllocation> uniformBufferAllocations;
-	std::vector<void*> uniformBuffersMapped;
+	glm::mat4 dequantize; // Maps unorm positions back to model space
+	glm::vec4 bounds;	  // Sphere around the unorm positions, see CachedModel
 
 	size_t materialId;
+};
 
-	void createUniform(VulkanContext& context);
-	void updateUniformBuffer(uint32_t currentImage);
+// Allocates a model's vertices and indices in the geometry arena. Safe to
+// call from any thread, the caller fills them in.
+void createMeshBuffers(VulkanContext& context,
+					   const ModelMetadata& metadata,
+					   CachedModel& model);
 
-	void cleanup(VulkanContext& context);
-};
+// Sphere around a model's positions, in the same unorm space. Any thread.
+glm::vec4 computeModelBounds(std::span<const u8> vertices, u64 vertexCount);
 
-void createVertexBuffer(VulkanContext& context,
-						const Vertex* vertices,
-						u64 vertexCount,
-						VkBuffer& buffer,
-						VmaAllocation& allocation);
-
-void createIndexBuffer(VulkanContext& context,
-					   const uint32_t* indices,
-					   u64 indexCount,
-					   VkBuffer& buffer,
-					   VmaAllocation& allocation);
-
-size_t createMesh(VulkanContext& context,
-				  Vertex* vertices,
-				  u64 vertexCount,
-				  uint32_t* indices,
-				  u64 indexCount,
-				  size_t materialId);
+// Gives a mesh whose geometry is filled in an ID. Main thread only.
+size_t addMesh(VulkanContext& context,
+			   Mesh* mesh,
+			   const ModelMetadata& metadata,
+			   size_t materialId);
 
 void createMeshDescriptorSetLayout(VulkanContext& context);
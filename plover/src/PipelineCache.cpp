@@ -0,0 +1,516 @@
+#include "PipelineCache.h"
+#include "VulkanContext.h"
+#include "plover_int.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+
+// Written in front of the driver's cache data, which is only handed back to
+// the same device and driver
+struct PipelineCacheHeader {
+	u32 magic;
+	u32 vendorID;
+	u32 deviceID;
+	u32 driverVersion;
+	u8 deviceUUID[VK_UUID_SIZE];
+	u8 pipelineCacheUUID[VK_UUID_SIZE];
+	u64 dataSize;
+};
+
+#define PIPELINE_CACHE_MAGIC 0x43504c50 // "PLPC"
+
+internal_func void appendBytes(std::string &key, const void *data,
+							   size_t size) {
+	key.append((const char *)data, size);
+}
+
+internal_func void appendString(std::string &key, const std::string &string) {
+	u64 size = string.size();
+	appendBytes(key, &size, sizeof(size));
+	key.append(string);
+}
+
+internal_func std::vector<char> readShaderFile(const std::string &path) {
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open shader " + path + "!");
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	std::vector<char> buffer(fileSize);
+	file.seekg(0);
+	file.read(buffer.data(), fileSize);
+	return buffer;
+}
+
+internal_func PipelineCacheHeader deviceHeader(VulkanContext &context) {
+	VkPhysicalDeviceIDProperties idProperties{};
+	idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &idProperties;
+	vkGetPhysicalDeviceProperties2(context.physicalDevice, &properties);
+
+	PipelineCacheHeader header{};
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.vendorID = properties.properties.vendorID;
+	header.deviceID = properties.properties.deviceID;
+	header.driverVersion = properties.properties.driverVersion;
+	memcpy(header.deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+	memcpy(header.pipelineCacheUUID, properties.properties.pipelineCacheUUID,
+		   VK_UUID_SIZE);
+	return header;
+}
+
+void PipelineCache::init(VulkanContext *context) {
+	this->context = context;
+	workers.init(defaultWorkerCount());
+	load();
+}
+
+// Starts from the cache on disk, when it was saved by this device and driver
+void PipelineCache::load() {
+	PipelineCacheHeader expected = deviceHeader(*context);
+	std::vector<char> data;
+
+	std::ifstream file(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		size_t fileSize = (size_t)file.tellg();
+		PipelineCacheHeader header{};
+		file.seekg(0);
+		if (fileSize >= sizeof(header) &&
+			file.read((char *)&header, sizeof(header)) &&
+			header.dataSize == fileSize - sizeof(header)) {
+			// Only the data size is allowed to differ
+			expected.dataSize = header.dataSize;
+			if (memcmp(&header, &expected, sizeof(header)) == 0) {
+				data.resize(header.dataSize);
+				file.read(data.data(), data.size());
+			}
+		}
+	}
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.data();
+	if (vkCreatePipelineCache(context->device, &createInfo, nullptr, &cache) ==
+		VK_SUCCESS) {
+		return;
+	}
+
+	// NOTE: Drivers may still reject the data, starting empty is fine
+	createInfo.initialDataSize = 0;
+	createInfo.pInitialData = nullptr;
+	if (vkCreatePipelineCache(context->device, &createInfo, nullptr, &cache) !=
+		VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+}
+
+void PipelineCache::save() {
+	size_t size = 0;
+	vkGetPipelineCacheData(context->device, cache, &size, nullptr);
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(context->device, cache, &size, data.data()) !=
+		VK_SUCCESS) {
+		DEBUG_log("failed to read pipeline cache data!\n");
+		return;
+	}
+
+	PipelineCacheHeader header = deviceHeader(*context);
+	header.dataSize = size;
+
+	// Written next to it first, so a crash never leaves half a cache behind
+	std::string tempPath = PIPELINE_CACHE_PATH ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open() ||
+			!file.write((const char *)&header, sizeof(header)) ||
+			!file.write(data.data(), size)) {
+			DEBUG_log("failed to write pipeline cache!\n");
+			return;
+		}
+	}
+	std::rename(tempPath.c_str(), PIPELINE_CACHE_PATH);
+}
+
+VkShaderModule PipelineCache::loadShaderModule(const std::string &path) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = shaderModules.find(path);
+		if (it != shaderModules.end()) {
+			return it->second;
+		}
+	}
+
+	VkShaderModule module =
+		context->createShaderModule(readShaderFile(path));
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto inserted = shaderModules.insert({path, module});
+	if (!inserted.second) {
+		// Another worker loaded it first
+		vkDestroyShaderModule(context->device, module, nullptr);
+	}
+	return inserted.first->second;
+}
+
+std::shared_future<PipelineCache::Pipeline>
+PipelineCache::acquire(const PipelineCreateInfo &info) {
+	PipelineState state{};
+	state.useDepthBuffer = info.useDepthBuffer;
+	state.doCulling = info.doCulling;
+	state.wireframeMode = info.wireframeMode;
+	state.subpass = info.subpass;
+	state.vertexShaderPath = info.vertexShaderPath;
+	state.fragmentShaderPath = info.fragmentShaderPath;
+	state.descriptorSetLayouts.assign(info.pDescriptorSetLayouts,
+									  info.pDescriptorSetLayouts +
+										  info.descriptorSetLayoutCount);
+	state.bindingDescriptions.assign(info.pBindingDescriptions,
+									 info.pBindingDescriptions +
+										 info.bindingDescriptionCount);
+	state.attributeDescriptions.assign(info.pAttributeDescriptions,
+									   info.pAttributeDescriptions +
+										   info.attributeDescriptionCount);
+
+	// NOTE: The descriptions are plain u32s, so their bytes are their state
+	std::string key;
+	u8 flags = (state.useDepthBuffer ? 1 : 0) | (state.doCulling ? 2 : 0) |
+			   (state.wireframeMode ? 4 : 0);
+	appendBytes(key, &flags, sizeof(flags));
+	appendBytes(key, &state.subpass, sizeof(state.subpass));
+	appendString(key, state.vertexShaderPath);
+	appendString(key, state.fragmentShaderPath);
+	u64 count = state.descriptorSetLayouts.size();
+	appendBytes(key, &count, sizeof(count));
+	appendBytes(key, state.descriptorSetLayouts.data(),
+				count * sizeof(VkDescriptorSetLayout));
+	count = state.bindingDescriptions.size();
+	appendBytes(key, &count, sizeof(count));
+	appendBytes(key, state.bindingDescriptions.data(),
+				count * sizeof(VkVertexInputBindingDescription));
+	count = state.attributeDescriptions.size();
+	appendBytes(key, &count, sizeof(count));
+	appendBytes(key, state.attributeDescriptions.data(),
+				count * sizeof(VkVertexInputAttributeDescription));
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(key);
+	if (it != entries.end()) {
+		it->second.references++;
+		return it->second.result;
+	}
+
+	auto promise = std::make_shared<std::promise<Pipeline>>();
+	Entry &entry = entries[key];
+	entry.result = promise->get_future().share();
+	entry.references = 1;
+
+	workers.push([this, promise, state, key] {
+		try {
+			Pipeline pipeline = build(state);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				keys[pipeline.pipeline] = key;
+			}
+			promise->set_value(pipeline);
+		} catch (...) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				entries.erase(key);
+			}
+			promise->set_exception(std::current_exception());
+		}
+	});
+	return entry.result;
+}
+
+void PipelineCache::request(const PipelineCreateInfo &info,
+							VkPipeline *pipeline,
+							VkPipelineLayout *pipelineLayout) {
+	std::shared_future<Pipeline> result = acquire(info);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	requests.push_back({result, pipeline, pipelineLayout});
+}
+
+void PipelineCache::finish() {
+	std::vector<Request> waiting;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		waiting.swap(requests);
+	}
+
+	for (Request &request : waiting) {
+		Pipeline pipeline = request.result.get();
+		*request.pipeline = pipeline.pipeline;
+		*request.pipelineLayout = pipeline.layout;
+	}
+}
+
+void PipelineCache::create(const PipelineCreateInfo &info,
+						   VkPipeline &pipeline,
+						   VkPipelineLayout &pipelineLayout) {
+	Pipeline created = acquire(info).get();
+	pipeline = created.pipeline;
+	pipelineLayout = created.layout;
+}
+
+void PipelineCache::release(VkPipeline pipeline) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto key = keys.find(pipeline);
+	if (key == keys.end()) {
+		throw std::runtime_error("failed to release unknown pipeline!");
+	}
+
+	Entry &entry = entries.at(key->second);
+	entry.references--;
+	if (entry.references == 0) {
+		vkDestroyPipeline(context->device, pipeline, nullptr);
+		vkDestroyPipelineLayout(context->device, entry.result.get().layout,
+								nullptr);
+		entries.erase(key->second);
+		keys.erase(key);
+	}
+}
+
+void PipelineCache::cleanup() {
+	workers.cleanup();
+	finish();
+	save();
+
+	// Whatever is left was never released
+	for (auto &kv : keys) {
+		Pipeline pipeline = entries.at(kv.second).result.get();
+		vkDestroyPipeline(context->device, pipeline.pipeline, nullptr);
+		vkDestroyPipelineLayout(context->device, pipeline.layout, nullptr);
+	}
+	keys.clear();
+	entries.clear();
+
+	for (auto &kv : shaderModules) {
+		vkDestroyShaderModule(context->device, kv.second, nullptr);
+	}
+	shaderModules.clear();
+	vkDestroyPipelineCache(context->device, cache, nullptr);
+}
+
+void PipelineCache::createCompute(const ComputePipelineCreateInfo &info,
+								  VkPipeline &pipeline,
+								  VkPipelineLayout &pipelineLayout) {
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = info.pushConstantSize;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = info.descriptorSetLayoutCount;
+	pipelineLayoutInfo.pSetLayouts = info.pDescriptorSetLayouts;
+	pipelineLayoutInfo.pushConstantRangeCount =
+		info.pushConstantSize > 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, nullptr,
+							   &pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = loadShaderModule(info.shaderPath);
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipelineLayout;
+
+	if (vkCreateComputePipelines(context->device, cache, 1, &pipelineInfo,
+								 nullptr, &pipeline) != VK_SUCCESS) {
+		vkDestroyPipelineLayout(context->device, pipelineLayout, nullptr);
+		throw std::runtime_error("failed to create compute pipeline!");
+	}
+}
+
+// Worker thread
+PipelineCache::Pipeline PipelineCache::build(const PipelineState &state) {
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+	vertShaderStageInfo.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertShaderStageInfo.module = loadShaderModule(state.vertexShaderPath);
+	vertShaderStageInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+	fragShaderStageInfo.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragShaderStageInfo.module = loadShaderModule(state.fragmentShaderPath);
+	fragShaderStageInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
+													  fragShaderStageInfo};
+
+	std::vector<VkDynamicState> dynamicStates = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount =
+		static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	vertexInputInfo.vertexBindingDescriptionCount =
+		(u32)state.bindingDescriptions.size();
+	vertexInputInfo.pVertexBindingDescriptions =
+		state.bindingDescriptions.data();
+	vertexInputInfo.vertexAttributeDescriptionCount =
+		(u32)state.attributeDescriptions.size();
+	vertexInputInfo.pVertexAttributeDescriptions =
+		state.attributeDescriptions.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	// We are drawing triangles
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// NOTE: Viewport and scissor are dynamic, only their count matters
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	if (state.wireframeMode) {
+		rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
+	} else {
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	}
+	rasterizer.lineWidth = 1.0f; // Any larger requires wideLines GPU feature
+	if (state.doCulling) {
+		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	} else {
+		rasterizer.cullMode = VK_CULL_MODE_NONE;
+	}
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	// We don't need depth biasing
+	rasterizer.depthBiasEnable = VK_FALSE;
+	rasterizer.depthBiasConstantFactor = 0.0f;
+	rasterizer.depthBiasClamp = 0.0f;
+	rasterizer.depthBiasSlopeFactor = 0.0f;
+
+	// Multisampling is disabled for now
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.pSampleMask = nullptr;
+	multisampling.alphaToCoverageEnable = VK_FALSE;
+	multisampling.alphaToOneEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask =
+		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	colorBlendAttachment.blendEnable = VK_TRUE;
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachment.dstColorBlendFactor =
+		VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	// Global blend settings
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+	colorBlending.blendConstants[0] = 0.0f;
+	colorBlending.blendConstants[1] = 0.0f;
+	colorBlending.blendConstants[2] = 0.0f;
+	colorBlending.blendConstants[3] = 0.0f;
+
+	// Uniform vector setup
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = (u32)state.descriptorSetLayouts.size();
+	pipelineLayoutInfo.pSetLayouts = state.descriptorSetLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
+	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+	Pipeline pipeline{};
+	if (vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, nullptr,
+							   &pipeline.layout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	if (state.useDepthBuffer) {
+		depthStencil.depthTestEnable = VK_TRUE;
+		depthStencil.depthWriteEnable = VK_TRUE;
+		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+		depthStencil.depthBoundsTestEnable = VK_FALSE;
+		depthStencil.minDepthBounds = 0.0f;
+		depthStencil.maxDepthBounds = 1.0f;
+		depthStencil.stencilTestEnable = VK_FALSE;
+		depthStencil.front = {};
+		depthStencil.back = {};
+	} else {
+		depthStencil.depthTestEnable = VK_FALSE;
+	}
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+
+	pipelineInfo.layout = pipeline.layout;
+
+	pipelineInfo.renderPass = context->renderPass;
+	pipelineInfo.subpass = state.subpass;
+
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateGraphicsPipelines(context->device, cache, 1, &pipelineInfo,
+								  nullptr,
+								  &pipeline.pipeline) != VK_SUCCESS) {
+		vkDestroyPipelineLayout(context->device, pipeline.layout, nullptr);
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+	return pipeline;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "ThreadPool.h"
+#include "glfw.h"
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct VulkanContext;
+struct PipelineCreateInfo;
+struct ComputePipelineCreateInfo;
+
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+
+// Creates graphics pipelines on worker threads through a VkPipelineCache that
+// is kept on disk between runs, so drivers only compile shaders once per
+// device and driver version. Pipelines with the same state are only created
+// once and shared, which is why they're released rather than destroyed.
+//
+// Safe to use from any thread.
+struct PipelineCache {
+	void init(VulkanContext *context);
+
+	// Starts creating a pipeline, or shares the one with the same state. The
+	// handles are written out by the next finish, so they have to outlive it.
+	void request(const PipelineCreateInfo &info, VkPipeline *pipeline,
+				 VkPipelineLayout *pipelineLayout);
+	// Waits for every request made so far
+	void finish();
+	// Creates a pipeline, or shares the one with the same state, and waits
+	// for it
+	void create(const PipelineCreateInfo &info, VkPipeline &pipeline,
+				VkPipelineLayout &pipelineLayout);
+	// Destroys a pipeline and its layout once nothing shares them anymore
+	void release(VkPipeline pipeline);
+
+	// Creates a compute pipeline through the cache right away. They aren't
+	// shared, the caller destroys the pipeline and its layout.
+	void createCompute(const ComputePipelineCreateInfo &info,
+					   VkPipeline &pipeline, VkPipelineLayout &pipelineLayout);
+
+	// Saves the cache to disk
+	void cleanup();
+
+  private:
+	struct Pipeline {
+		VkPipeline pipeline;
+		VkPipelineLayout layout;
+	};
+
+	// Owning copy of a PipelineCreateInfo, for the workers
+	struct PipelineState {
+		bool useDepthBuffer;
+		bool doCulling;
+		bool wireframeMode;
+		u32 subpass;
+		std::string vertexShaderPath;
+		std::string fragmentShaderPath;
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+	};
+
+	struct Entry {
+		std::shared_future<Pipeline> result;
+		u32 references;
+	};
+
+	struct Request {
+		std::shared_future<Pipeline> result;
+		VkPipeline *pipeline;
+		VkPipelineLayout *pipelineLayout;
+	};
+
+	VulkanContext *context;
+	VkPipelineCache cache;
+	ThreadPool workers;
+
+	std::mutex mutex;
+	// By packed state, hashed by the map
+	std::unordered_map<std::string, Entry> entries;
+	std::unordered_map<VkPipeline, std::string> keys;
+	std::vector<Request> requests;
+	std::unordered_map<std::string, VkShaderModule> shaderModules;
+
+	std::shared_future<Pipeline> acquire(const PipelineCreateInfo &info);
+	Pipeline build(const PipelineState &state);
+	VkShaderModule loadShaderModule(const std::string &path);
+	void load();
+	void save();
+};
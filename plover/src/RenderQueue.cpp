@@ -0,0 +1,59 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+u64 renderKey(u32 pipeline, u32 material, u32 geometry, f32 depth) {
+	u64 maxDepth = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+	u64 quantized = (u64)(std::clamp(depth, 0.0f, 1.0f) * maxDepth);
+
+	u64 key = 0;
+	key |= (u64)pipeline << RENDER_KEY_PIPELINE_SHIFT;
+	key |= ((u64)material & ((1ull << RENDER_KEY_MATERIAL_BITS) - 1))
+		   << RENDER_KEY_MATERIAL_SHIFT;
+	key |= ((u64)geometry & ((1ull << RENDER_KEY_GEOMETRY_BITS) - 1))
+		   << RENDER_KEY_GEOMETRY_SHIFT;
+	key |= quantized << RENDER_KEY_DEPTH_SHIFT;
+	return key;
+}
+
+void radixSort(std::vector<RenderItem> &items,
+			   std::vector<RenderItem> &scratch) {
+	if (items.size() < 2) {
+		return;
+	}
+	scratch.resize(items.size());
+
+	// Histograms of all 8 bytes in one pass over the keys
+	u32 counts[8][256] = {};
+	for (const RenderItem &item : items) {
+		for (u32 pass = 0; pass < 8; pass++) {
+			counts[pass][(item.key >> (pass * 8)) & 0xff]++;
+		}
+	}
+
+	std::vector<RenderItem> *from = &items;
+	std::vector<RenderItem> *to = &scratch;
+	for (u32 pass = 0; pass < 8; pass++) {
+		u32 *count = counts[pass];
+		u32 shift = pass * 8;
+		// NOTE: Every key has the same byte, the pass wouldn't move anything
+		if (count[((*from)[0].key >> shift) & 0xff] == items.size()) {
+			continue;
+		}
+
+		u32 offsets[256];
+		u32 offset = 0;
+		for (u32 i = 0; i < 256; i++) {
+			offsets[i] = offset;
+			offset += count[i];
+		}
+		for (const RenderItem &item : *from) {
+			(*to)[offsets[(item.key >> shift) & 0xff]++] = item;
+		}
+		std::swap(from, to);
+	}
+
+	if (from != &items) {
+		items.swap(scratch);
+	}
+}
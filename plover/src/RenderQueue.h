@@ -0,0 +1,52 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include <vector>
+
+struct Mesh;
+
+// Sort key fields, most significant first. Draws sharing a prefix share the
+// state it stands for, so walking the sorted queue only rebinds what changed.
+#define RENDER_KEY_PIPELINE_BITS 8
+#define RENDER_KEY_MATERIAL_BITS 16
+#define RENDER_KEY_GEOMETRY_BITS 20 // Top bit is the index type
+#define RENDER_KEY_DEPTH_BITS 20
+
+#define RENDER_KEY_DEPTH_SHIFT 0
+#define RENDER_KEY_GEOMETRY_SHIFT (RENDER_KEY_DEPTH_SHIFT + RENDER_KEY_DEPTH_BITS)
+#define RENDER_KEY_MATERIAL_SHIFT                                              \
+	(RENDER_KEY_GEOMETRY_SHIFT + RENDER_KEY_GEOMETRY_BITS)
+#define RENDER_KEY_PIPELINE_SHIFT                                              \
+	(RENDER_KEY_MATERIAL_SHIFT + RENDER_KEY_MATERIAL_BITS)
+
+static_assert(RENDER_KEY_PIPELINE_SHIFT + RENDER_KEY_PIPELINE_BITS == 64);
+
+// Packs a key from dense per-frame IDs and a depth in [0, 1], nearest first
+u64 renderKey(u32 pipeline, u32 material, u32 geometry, f32 depth);
+
+inline u32 renderKeyField(u64 key, u32 shift, u32 bits) {
+	return (u32)((key >> shift) & ((1ull << bits) - 1));
+}
+
+struct RenderItem {
+	u64 key;
+	Mesh *mesh;
+};
+
+// Sorts items by key with an 8 bit LSD radix sort, stable, skipping the
+// passes over bytes every key shares. `scratch` is resized to match.
+void radixSort(std::vector<RenderItem> &items,
+			   std::vector<RenderItem> &scratch);
+
+// Draws of a frame, kept between frames so its memory is reused
+struct RenderQueue {
+	std::vector<RenderItem> items;
+
+	void clear() { items.clear(); }
+	void push(u64 key, Mesh *mesh) { items.push_back({key, mesh}); }
+	void sort() { radixSort(items, scratch); }
+
+  private:
+	std::vector<RenderItem> scratch;
+};
@@ -16,50 +16,56 @@ void Renderer::init() {
 	context->initVulkan();
 
     VoxelModelMetadata metadata;
-    Voxel *data = loader.loadVoxelModel("map.vox", &metadata);
+    AssetData voxels = loader.loadVoxelModel(assetID("map.vox"), &metadata);
+    // NOTE: The map owns and grows its voxels, so it gets its own copy
+    Voxel *data = (Voxel *) malloc(voxels.bytes.size());
+    memcpy(data, voxels.bytes.data(), voxels.bytes.size());
     VoxelMap map = VoxelMap(metadata, data, BitmapFormat::RGBA8);
 
     Texture lvlTex;
     createTexture(*context, map, lvlTex);
 
-	context->raycasterCtx = new RaycasterContext(lvlTex, context);
+    // NOTE: Blocks go in a map of their own, the color keeps all 4 channels
+    Voxel *blocks = (Voxel *) malloc(voxels.bytes.size());
+    for (u32 i = 0; i < metadata.amount_voxels; i++) {
+        blocks[i] = data[i];
+        blocks[i].color = data[i].block;
+    }
+    VoxelMap blockMap = VoxelMap(metadata, blocks, BitmapFormat::G8);
+
+    Texture blockTex;
+    createTexture(*context, blockMap, blockTex);
+
+	context->raycasterCtx = new RaycasterContext(lvlTex, blockTex, context);
+	context->sceneVersion++;
+
+	cache.init(context);
+	streamer.init(context, &loader, &cache);
+
+	// NOTE: Startup pipelines compile in parallel with the loading above
+	context->pipelines.finish();
 }
 
 bool Renderer::render() { return context->render(); }
 
 void Renderer::cleanup() {
+	streamer.cleanup();
+	cache.cleanup();
 	context->cleanup();
 	loader.cleanup();
 	delete this->context;
 }
 
 void Renderer::processCommand(RenderCommand inCmd) {
-	u32 cmdID = inCmd.id;
-
 	switch (inCmd.tag) {
-	case CREATE_MESH: {
-		CreateMeshData data = inCmd.v.createMesh;
-		ModelMetadata metadata;
-
-		ModelData modelData = loader.loadModel(data.name, &metadata);
-
-		RenderMessage message{MESH_CREATED, cmdID};
-		message.v.meshCreated.meshID =
-			createMesh(*context, (Vertex *)modelData.vertices,
-					   metadata.vertexCount, (uint32_t *)modelData.indices,
-					   metadata.indexCount, data.materialID);
-		messageQueue.push(message);
+	case CREATE_MESH:
+	case CREATE_MATERIAL: {
+		// NOTE: Answered by the streamer once the asset is on the GPU
+		streamer.request(inCmd);
 		break;
 	}
-	case CREATE_MATERIAL: {
-		CreateMaterialData materialData = inCmd.v.createMaterial;
-		const char *textureName = materialData.textureName;
-		const char *normalName = materialData.normalName;
-
-		RenderMessage message{MATERIAL_CREATED, cmdID};
-		message.v.materialCreated.materialID =
-			createMaterial(*context, loader, textureName, normalName);
-		messageQueue.push(message);
+	case DESTROY_MESH: {
+		streamer.destroyMesh(inCmd.v.destroyMesh.meshID);
 		break;
 	}
 	case SET_MESH_TRANSFORM: {
@@ -75,10 +81,10 @@ void Renderer::processCommand(RenderCommand inCmd) {
 	}
 	case SET_RENDER_MODE: {
 		SetRenderModeData renderModeData = inCmd.v.setRenderMode;
-		if (renderModeData.mode == RENDER_MODE_WIREFRAME) {
-			context->wireframeEnabled = true;
-		} else {
-			context->wireframeEnabled = false;
+		bool wireframe = renderModeData.mode == RENDER_MODE_WIREFRAME;
+		if (wireframe != context->wireframeEnabled) {
+			context->wireframeEnabled = wireframe;
+			context->sceneVersion++;
 		}
 		break;
 	}
@@ -89,6 +95,9 @@ void Renderer::processCommands() {
 	while (commandQueue.hasMessage()) {
 		processCommand(commandQueue.pop());
 	}
+	streamer.update(messageQueue);
+	// Records this frame's share of the queued uploads in one submission
+	context->uploads.update();
 }
 
 void Renderer::UI_Clear() { context->ui.clear(); }
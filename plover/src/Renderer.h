@@ -5,6 +5,7 @@
 #include "MessageQueue.h"
 #include "VulkanContext.h"
 #include "AssetLoader.h"
+#include "AssetStreamer.h"
 
 struct Renderer {
 	VulkanContext* context;
@@ -12,6 +13,8 @@ struct Renderer {
 	MessageQueue<RenderCommand> commandQueue;
 	MessageQueue<RenderMessage> messageQueue;
 	AssetLoader loader;
+	GpuCache cache;
+	AssetStreamer streamer;
 
 	void init();
 	bool render();
@@ -0,0 +1,133 @@
+#include "SecondaryRecorder.h"
+#include "VulkanContext.h"
+
+#include <future>
+#include <stdexcept>
+
+void SecondaryRecorder::init(VulkanContext *context, u32 chunkSlots) {
+	this->context = context;
+	// NOTE: Chunk 0 is recorded by the calling thread
+	workers.init(chunkSlots - 1);
+
+	slots.resize(chunkSlots);
+	for (std::vector<SlotFrame> &slot : slots) {
+		slot.resize(MAX_FRAMES_IN_FLIGHT);
+		for (SlotFrame &slotFrame : slot) {
+			context->createCommandPool(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+									   slotFrame.pool);
+			slotFrame.used = 0;
+		}
+	}
+}
+
+void SecondaryRecorder::beginFrame(u32 frame) {
+	for (std::vector<SlotFrame> &slot : slots) {
+		vkResetCommandPool(context->device, slot[frame].pool, 0);
+		slot[frame].used = 0;
+	}
+}
+
+// Only ever called for a slot by the thread recording its chunk
+VkCommandBuffer SecondaryRecorder::acquire(u32 slot, u32 frame) {
+	SlotFrame &slotFrame = slots[slot][frame];
+	if (slotFrame.used == slotFrame.buffers.size()) {
+		VkCommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocateInfo.commandPool = slotFrame.pool;
+		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocateInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(context->device, &allocateInfo,
+									 &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to allocate secondary command buffer!");
+		}
+		slotFrame.buffers.push_back(commandBuffer);
+	}
+	return slotFrame.buffers[slotFrame.used++];
+}
+
+std::vector<VkCommandBuffer> SecondaryRecorder::record(
+	u32 frame, VkFramebuffer framebuffer, u32 subpass, u32 chunkCount,
+	const std::function<void(VkCommandBuffer commandBuffer, u32 chunk)>
+		&recordChunk) {
+	if (chunkCount == 0 || chunkCount > chunkSlots()) {
+		throw std::invalid_argument("failed to record unsupported chunk count!");
+	}
+
+	std::vector<VkCommandBuffer> commandBuffers(chunkCount);
+	auto recordSlot = [&, frame, framebuffer, subpass](u32 chunk) {
+		VkCommandBuffer commandBuffer = acquire(chunk, frame);
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType =
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = context->renderPass;
+		inheritanceInfo.subpass = subpass;
+		inheritanceInfo.framebuffer = framebuffer;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		// NOTE: Not one time submit, static scenes execute them again
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to begin recording secondary command buffer!");
+		}
+		recordChunk(commandBuffer, chunk);
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to record secondary command buffer!");
+		}
+		commandBuffers[chunk] = commandBuffer;
+	};
+
+	std::vector<std::future<void>> recorded;
+	for (u32 chunk = 1; chunk < chunkCount; chunk++) {
+		auto done = std::make_shared<std::promise<void>>();
+		recorded.push_back(done->get_future());
+		workers.push([recordSlot, done, chunk] {
+			try {
+				recordSlot(chunk);
+				done->set_value();
+			} catch (...) {
+				done->set_exception(std::current_exception());
+			}
+		});
+	}
+
+	// NOTE: Workers still hold references to this frame, so wait for all of
+	// them before letting an error through
+	std::exception_ptr error;
+	try {
+		recordSlot(0);
+	} catch (...) {
+		error = std::current_exception();
+	}
+	for (std::future<void> &chunk : recorded) {
+		try {
+			chunk.get();
+		} catch (...) {
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+	return commandBuffers;
+}
+
+void SecondaryRecorder::cleanup() {
+	workers.cleanup();
+	for (std::vector<SlotFrame> &slot : slots) {
+		for (SlotFrame &slotFrame : slot) {
+			vkDestroyCommandPool(context->device, slotFrame.pool, nullptr);
+		}
+	}
+	slots.clear();
+}
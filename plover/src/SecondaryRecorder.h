@@ -0,0 +1,51 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "ThreadPool.h"
+#include "glfw.h"
+
+#include <functional>
+#include <vector>
+
+struct VulkanContext;
+
+// Records a subpass as several secondary command buffers at once, one per
+// chunk, chunk 0 on the calling thread and the rest on workers. Each chunk
+// slot has its own command pool per frame in flight, so recording never
+// shares a pool between threads. A frame's pools are reset as a whole when
+// it's recorded again, until then its buffers can be executed again.
+//
+// Main thread only.
+struct SecondaryRecorder {
+	void init(VulkanContext *context, u32 chunkSlots);
+
+	// Most chunks a subpass can be split into
+	u32 chunkSlots() const { return (u32)slots.size(); }
+
+	// Resets the frame's pools before recording it again, call once the
+	// frame's fence has signaled
+	void beginFrame(u32 frame);
+	// Records `chunkCount` chunks inheriting the subpass, and returns their
+	// command buffers in chunk order, ready to be executed. A chunk's
+	// secondary doesn't inherit any state, it has to bind all it uses.
+	std::vector<VkCommandBuffer>
+	record(u32 frame, VkFramebuffer framebuffer, u32 subpass, u32 chunkCount,
+		   const std::function<void(VkCommandBuffer commandBuffer, u32 chunk)>
+			   &recordChunk);
+
+	void cleanup();
+
+  private:
+	struct SlotFrame {
+		VkCommandPool pool;
+		std::vector<VkCommandBuffer> buffers;
+		u32 used; // Since the last reset
+	};
+
+	VulkanContext *context;
+	ThreadPool workers;
+	std::vector<std::vector<SlotFrame>> slots; // By chunk slot, then frame
+
+	VkCommandBuffer acquire(u32 slot, u32 frame);
+};
@@ -55,8 +55,9 @@ void Bitmap::writeRGBA(UVec4 color, u32 x, u32 y) {
 	}
 }
 
-void createTexture(VulkanContext &context, Bitmap bitmap, Texture &texture) {
-	texture.imageSize = bitmap.width * bitmap.height * bitmap.stride();
+void createTextureResources(VulkanContext &context, Bitmap bitmap,
+							Texture &texture) {
+	texture.imageSize = bitmap.size();
 	texture.format = bitmap.vulkanFormat();
 
 	CreateImageInfo imageInfo{};
@@ -64,6 +65,7 @@ void createTexture(VulkanContext &context, Bitmap bitmap, Texture &texture) {
 	imageInfo.height = bitmap.height;
 	imageInfo.format = texture.format;
 	imageInfo.layers = 1;
+	imageInfo.mipLevels = bitmap.mipLevels;
 	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	imageInfo.usage =
 		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
@@ -71,17 +73,21 @@ void createTexture(VulkanContext &context, Bitmap bitmap, Texture &texture) {
 	imageInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(0);
 	context.createImage(imageInfo, texture.image, texture.allocation);
 
-	texture.copyBitmap(context, bitmap);
-
 	CreateImageViewInfo imageViewInfo{};
 	imageViewInfo.image = texture.image;
 	imageViewInfo.format = texture.format;
 	imageViewInfo.aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
 	imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 	imageViewInfo.layers = 1;
+	imageViewInfo.mipLevels = bitmap.mipLevels;
 	context.createImageView(imageViewInfo, &texture.imageView);
 
-	// Create sampler
+	// NOTE: The material table samples its textures with a shared sampler
+	texture.sampler = VK_NULL_HANDLE;
+}
+
+internal_func void createTextureSampler(VulkanContext &context, Bitmap bitmap,
+										Texture &texture) {
 	VkPhysicalDeviceFeatures supportedFeatures;
 	vkGetPhysicalDeviceFeatures(context.physicalDevice, &supportedFeatures);
 	VkPhysicalDeviceProperties properties{};
@@ -104,7 +110,7 @@ void createTexture(VulkanContext &context, Bitmap bitmap, Texture &texture) {
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = (float)bitmap.mipLevels;
 
 	if (vkCreateSampler(context.device, &samplerInfo, nullptr,
 						&(texture.sampler)) != VK_SUCCESS) {
@@ -112,57 +118,102 @@ void createTexture(VulkanContext &context, Bitmap bitmap, Texture &texture) {
 	}
 }
 
-void createImageTexture(VulkanContext &context, AssetLoader loader,
-						Texture &texture, const char *name,
-						BitmapFormat format) {
+void createTexture(VulkanContext &context, Bitmap bitmap, Texture &texture) {
+	createTextureResources(context, bitmap, texture);
+	createTextureSampler(context, bitmap, texture);
+	texture.copyBitmap(context, bitmap);
+}
+
+// The packed format decides the layout, `format` only whether it's sRGB
+internal_func BitmapFormat packedBitmapFormat(TextureFormat packed,
+											  BitmapFormat format) {
+	bool srgb = format == SRGBA8;
+	switch (packed) {
+	case TEXTURE_RGBA8:
+		return format;
+	case TEXTURE_BC1:
+		return srgb ? BC1_SRGBA : BC1_RGBA;
+	case TEXTURE_BC3:
+		return srgb ? BC3_SRGBA : BC3_RGBA;
+	case TEXTURE_BC5:
+		return BC5_RG;
+	case TEXTURE_BC7:
+		return srgb ? BC7_SRGBA : BC7_RGBA;
+	}
+	throw std::runtime_error("failed to load texture with unknown format!");
+}
+
+Bitmap loadImageBitmap(VulkanContext &context, const AssetLoader &loader,
+					   u64 assetID, BitmapFormat format, AssetData &pixels) {
 	TextureMetadata info{};
 
+	// NOTE: Uploaded straight out of the mapped pack when uncompressed
+	pixels = loader.loadTexture(assetID, &info);
+
 	Bitmap bitmap{};
-	bitmap.pixels = loader.loadTexture(name, &info);
+	bitmap.pixels = (void *)pixels.bytes.data();
 	bitmap.width = info.width;
 	bitmap.height = info.height;
-	bitmap.format = format;
+	bitmap.format = packedBitmapFormat(info.format, format);
+	if (blockSize(bitmap.format) > 1) {
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(context.physicalDevice,
+									&supportedFeatures);
+		if (!supportedFeatures.textureCompressionBC) {
+			throw std::runtime_error(
+				"failed to load block compressed texture, repack the assets "
+				"with lapwing --no-bc!");
+		}
+	}
+	if (info.mipLevels == 0 || info.mipLevels > MAX_MIP_LEVELS) {
+		throw std::runtime_error("failed to load texture with invalid mip "
+								 "level count!");
+	}
+	bitmap.mipLevels = info.mipLevels;
+
+	// NOTE: Levels are read straight out of the pack, so every one of them
+	// has to end inside the asset's pixel data
+	u64 pixelsSize = pixels.bytes.size();
+	for (u32 level = 0; level < bitmap.mipLevels; level++) {
+		bitmap.mipOffsets[level] = info.mipOffsets[level];
+		if (info.mipOffsets[level] > pixelsSize ||
+			bitmap.levelSize(level) > pixelsSize - info.mipOffsets[level]) {
+			throw std::runtime_error("failed to load texture, mip level "
+									 "exceeds the pixel data!");
+		}
+	}
+	return bitmap;
+}
+
+void Texture::addCopy(Upload &upload, Bitmap bitmap) {
+	upload.images.push_back({image, 1, bitmap.mipLevels});
 
-	createTexture(context, bitmap, texture);
+	assert(bitmap.mipLevels <= MAX_MIP_LEVELS &&
+		   "Too many mip levels when copying texture!");
+
+	u32 block = blockSize(bitmap.format);
+	for (u32 level = 0; level < bitmap.mipLevels; level++) {
+		const u8 *pixels = (const u8 *)bitmap.pixels + bitmap.mipOffsets[level];
+
+		u32 width = bitmap.levelWidth(level);
+		u32 height = bitmap.levelHeight(level);
+		VkDeviceSize rowSize =
+			(VkDeviceSize)((width + block - 1) / block) * bitmap.stride();
+		upload.addImage(pixels, image, level, 0, 1, {width, height, 1},
+						rowSize, block);
+	}
 }
 
 void Texture::copyBitmap(VulkanContext &context, Bitmap bitmap) {
-	assert(bitmap.width * bitmap.height * bitmap.stride() == imageSize &&
+	assert(bitmap.size() == imageSize &&
 		   "Image size mismatch when updating texture!");
 	assert(bitmap.vulkanFormat() == format &&
 		   "Format mismatch when updating texture!");
 
-	VkBuffer stagingBuffer;
-	VmaAllocation stagingBufferAllocation;
-
-	CreateBufferInfo stagingCreateInfo{};
-	stagingCreateInfo.size = imageSize;
-	stagingCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	stagingCreateInfo.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-								   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	stagingCreateInfo.vmaFlags =
-		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-
-	context.createBuffer(stagingCreateInfo, stagingBuffer,
-						 stagingBufferAllocation);
-
-	void *data;
-	vmaMapMemory(context.allocator, stagingBufferAllocation, &data);
-	memcpy(data, bitmap.pixels, static_cast<size_t>(imageSize));
-	vmaUnmapMemory(context.allocator, stagingBufferAllocation);
-
-	// TODO(oliver): These all create and submit a new command buffer.  Should
-	// change this to use a single command buffer
-	// TODO(oliver): Change these to non-array versions!
-	context.transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED,
-								  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
-	context.copyBufferToImage(stagingBuffer, image, bitmap.width, bitmap.height,
-							  imageSize, 1);
-	context.transitionImageLayout(image, format,
-								  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-								  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
-
-	vmaDestroyBuffer(context.allocator, stagingBuffer, stagingBufferAllocation);
+	Upload upload{};
+	upload.priority = UPLOAD_PRIORITY_HIGH;
+	addCopy(upload, bitmap);
+	context.uploads.uploadAndWait(upload);
 }
 
 void Texture::copyVoxelmap(VulkanContext &context, VoxelMap &voxelmap) {
@@ -173,25 +224,7 @@ void Texture::copyVoxelmap(VulkanContext &context, VoxelMap &voxelmap) {
 	assert(voxelmap.vulkanFormat() == format &&
 		   "Format mismatch when updating texture!");
 
-	VkBuffer stagingBuf;
-	VmaAllocation stagingBufAlloc;
-
-	CreateBufferInfo stagingInfo{
-		.size = imageSize,
-		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-					  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		.vmaFlags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT};
-
-	context.createBuffer(stagingInfo, stagingBuf, stagingBufAlloc);
-
-	uint8_t *data;
-	vmaMapMemory(context.allocator, stagingBufAlloc, (void **)&data);
-	for (size_t i = 0; i < voxelmap.height * voxelmap.width * voxelmap.depth *
-							   voxelmap.stride();
-		 i++) {
-		data[i] = 0;
-	}
+	std::vector<u8> data(imageSize, 0);
 	for (size_t i = 0; i < voxelmap.amount_voxels; i++) {
 		uint8_t w = voxelmap.voxels[i].pos[0];
 		uint8_t h = voxelmap.voxels[i].pos[1];
@@ -201,22 +234,25 @@ void Texture::copyVoxelmap(VulkanContext &context, VoxelMap &voxelmap) {
 		case G8:
 			data[voxelmap.width * voxelmap.height * d + voxelmap.width * h +
 				 w] = (u8)voxelmap.voxels[i].color;
+			break;
 		case RGBA8:
 		case SRGBA8:
-			((u32 *)data)[voxelmap.width * voxelmap.height * d +
-						  voxelmap.width * h + w] = voxelmap.voxels[i].color;
+			((u32 *)data.data())[voxelmap.width * voxelmap.height * d +
+								 voxelmap.width * h + w] =
+				voxelmap.voxels[i].color;
+			break;
 		}
 	}
-	vmaUnmapMemory(context.allocator, stagingBufAlloc);
-
-	context.transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED,
-								  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
-	context.copyBufferToImage(stagingBuf, image, voxelmap.width,
-							  voxelmap.height, voxelmap.depth, imageSize, 1);
-	context.transitionImageLayout(image, format,
-								  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-								  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
-	vmaDestroyBuffer(context.allocator, stagingBuf, stagingBufAlloc);
+
+	// NOTE: Large maps are split by depth slices, so the staging ring never
+	// has to hold all of it at once
+	Upload upload{};
+	upload.priority = UPLOAD_PRIORITY_HIGH;
+	upload.images.push_back({image, 1, 1});
+	upload.addImage(data.data(), image, 0, 0, 1,
+					{voxelmap.width, voxelmap.height, voxelmap.depth},
+					voxelmap.width * voxelmap.stride(), 1);
+	context.uploads.uploadAndWait(upload);
 }
 
 void Texture::cleanup(VulkanContext &context) {
@@ -294,39 +330,15 @@ void ArrayTexture::copyBitmaps(VulkanContext &context, Bitmap *bitmaps) {
 	assert(bitmaps[0].vulkanFormat() == format &&
 		   "Format mismatch when updating texture!");
 
-	VkBuffer stagingBuffer;
-	VmaAllocation stagingBufferAllocation;
-
-	CreateBufferInfo stagingCreateInfo{};
-	stagingCreateInfo.size = imageSize * layers;
-	stagingCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	stagingCreateInfo.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-								   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	stagingCreateInfo.vmaFlags =
-		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-
-	context.createBuffer(stagingCreateInfo, stagingBuffer,
-						 stagingBufferAllocation);
-
-	void *data;
-	vmaMapMemory(context.allocator, stagingBufferAllocation, &data);
+	Upload upload{};
+	upload.priority = UPLOAD_PRIORITY_HIGH;
+	upload.images.push_back({image, layers, 1});
 	for (u32 layer = 0; layer < layers; layer++) {
-		memcpy((u8 *)data + layer * imageSize, bitmaps[layer].pixels,
-			   static_cast<size_t>(imageSize));
+		upload.addImage(bitmaps[layer].pixels, image, 0, layer, 1,
+						{bitmaps[0].width, bitmaps[0].height, 1},
+						bitmaps[0].width * bitmaps[0].stride(), 1);
 	}
-	vmaUnmapMemory(context.allocator, stagingBufferAllocation);
-
-	// TODO(oliver): These all create and submit a new command buffer.  Should
-	// change this to use a single command buffer
-	context.transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED,
-								  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layers);
-	context.copyBufferToImage(stagingBuffer, image, bitmaps[0].width,
-							  bitmaps[0].height, imageSize, layers);
-	context.transitionImageLayout(
-		image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, layers);
-
-	vmaDestroyBuffer(context.allocator, stagingBuffer, stagingBufferAllocation);
+	context.uploads.uploadAndWait(upload);
 }
 
 void ArrayTexture::cleanup(VulkanContext &context) {
@@ -414,6 +426,14 @@ void createTexture(VulkanContext &context, VoxelMap &voxelmap,
 										 VK_IMAGE_USAGE_SAMPLED_BIT,
 								.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 								.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	// NOTE: Copied on the transfer queue, see VulkanContext::createImage
+	uint32_t families[] = {context.queueFamilies.graphicsFamily.value(),
+						   context.queueFamilies.transferFamily.value()};
+	if (families[0] != families[1]) {
+		imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		imageInfo.queueFamilyIndexCount = 2;
+		imageInfo.pQueueFamilyIndices = families;
+	}
 	VmaAllocationCreateInfo allocCreateInfo{
 		.flags = 0,
 		.usage = VMA_MEMORY_USAGE_AUTO,
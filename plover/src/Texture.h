@@ -3,9 +3,11 @@
 #include <plover/plover.h>
 
 #include "AssetLoader.h"
+#include "UploadManager.h"
 #include "lapwing.h"
 
 #include <vma/vk_mem_alloc.h>
+#include <algorithm>
 
 struct VulkanContext;
 
@@ -13,18 +15,49 @@ enum BitmapFormat {
 	G8,		// 8-bit gray
 	RGBA8,	// 8-bit rgba
 	SRGBA8, // 8-bit srgba
+	// Block compressed, as packed by lapwing
+	BC1_RGBA,
+	BC1_SRGBA,
+	BC3_RGBA,
+	BC3_SRGBA,
+	BC5_RG,
+	BC7_RGBA,
+	BC7_SRGBA,
 };
 
+// Bytes per texel, or per 4x4 block for block compressed formats
 inline u32 stride(BitmapFormat format);
+inline u32 blockSize(BitmapFormat format);
 inline VkFormat vulkanFormat(BitmapFormat format);
 struct Bitmap {
 	void *pixels;
 	u32 width;
 	u32 height;
 	BitmapFormat format;
+	// Byte offset of each level in pixels, level 0 is always at 0
+	u32 mipLevels = 1;
+	u64 mipOffsets[MAX_MIP_LEVELS] = {};
 
 	inline u32 stride() { return ::stride(format); }
 
+	inline u32 levelWidth(u32 level) { return std::max(1u, width >> level); }
+	inline u32 levelHeight(u32 level) { return std::max(1u, height >> level); }
+
+	inline u64 levelSize(u32 level) {
+		u32 block = blockSize(format);
+		return (u64)((levelWidth(level) + block - 1) / block) *
+			   ((levelHeight(level) + block - 1) / block) * stride();
+	}
+
+	// Bytes of all levels
+	inline u64 size() {
+		u64 size = 0;
+		for (u32 level = 0; level < mipLevels; level++) {
+			size += levelSize(level);
+		}
+		return size;
+	}
+
 	inline VkFormat vulkanFormat() {
         return ::vulkanFormat(format);
 	}
@@ -74,17 +107,28 @@ struct Texture {
 	VmaAllocation allocation;
 	VkImageView imageView;
 	VkSampler sampler;
+	// Slot in the material table, cached textures only
+	u32 tableSlot;
 
 	void copyBitmap(VulkanContext &context, Bitmap bitmap);
+	// Adds the copy of every level of a bitmap to an upload. The pixels have
+	// to outlive it.
+	void addCopy(Upload &upload, Bitmap bitmap);
 	void copyVoxelmap(VulkanContext &context, VoxelMap &voxelmap);
 	void cleanup(VulkanContext &context);
 };
 
+// Creates the image and view of a texture without filling it in, for the
+// material table. Only uses the device and the allocator, so it is safe on any
+// thread.
+void createTextureResources(VulkanContext &context, Bitmap bitmap,
+							Texture &texture);
 void createTexture(VulkanContext &context, Bitmap bitmap, Texture &texture);
 void createTexture(VulkanContext &context, VoxelMap &voxelmap, Texture &texture);
-void createImageTexture(VulkanContext &context, AssetLoader loader,
-						Texture &texture, const char *name,
-						BitmapFormat format);
+// Loads a packed image as a bitmap. `format` only picks between the sRGB and
+// linear variants of the packed format. Pixels stay valid as long as `pixels`.
+Bitmap loadImageBitmap(VulkanContext &context, const AssetLoader &loader,
+					   u64 assetID, BitmapFormat format, AssetData &pixels);
 
 struct ArrayTexture {
 	VkFormat format;
@@ -115,6 +159,25 @@ inline u32 stride(BitmapFormat format) {
 		return 4;
 	case SRGBA8:
 		return 4;
+	case BC1_RGBA:
+	case BC1_SRGBA:
+		return 8;
+	case BC3_RGBA:
+	case BC3_SRGBA:
+	case BC5_RG:
+	case BC7_RGBA:
+	case BC7_SRGBA:
+		return 16;
+	}
+}
+inline u32 blockSize(BitmapFormat format) {
+	switch (format) {
+	case G8:
+	case RGBA8:
+	case SRGBA8:
+		return 1;
+	default:
+		return 4;
 	}
 }
 inline VkFormat vulkanFormat(BitmapFormat format) {
@@ -125,5 +188,19 @@ inline VkFormat vulkanFormat(BitmapFormat format) {
 			return VK_FORMAT_R8G8B8A8_UNORM;
 		case SRGBA8:
 			return VK_FORMAT_R8G8B8A8_SRGB;
+		case BC1_RGBA:
+			return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+		case BC1_SRGBA:
+			return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		case BC3_RGBA:
+			return VK_FORMAT_BC3_UNORM_BLOCK;
+		case BC3_SRGBA:
+			return VK_FORMAT_BC3_SRGB_BLOCK;
+		case BC5_RG:
+			return VK_FORMAT_BC5_UNORM_BLOCK;
+		case BC7_RGBA:
+			return VK_FORMAT_BC7_UNORM_BLOCK;
+		case BC7_SRGBA:
+			return VK_FORMAT_BC7_SRGB_BLOCK;
 		}
 }
@@ -0,0 +1,51 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+void ThreadPool::init(u32 threadCount) {
+	stopping = false;
+	for (u32 i = 0; i < threadCount; i++) {
+		threads.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+void ThreadPool::push(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::work() {
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [&] { return stopping || !jobs.empty(); });
+			if (jobs.empty()) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void ThreadPool::cleanup() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+}
+
+u32 defaultWorkerCount() {
+	u32 cores = std::thread::hardware_concurrency();
+	return std::max(cores, 2u) - 1;
+}
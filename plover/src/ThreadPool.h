@@ -0,0 +1,32 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running jobs in the order they were pushed.
+struct ThreadPool {
+	void init(u32 threadCount);
+	void push(std::function<void()> job);
+	// Finishes the queued jobs, then joins the workers
+	void cleanup();
+
+	u32 threadCount() const { return (u32)threads.size(); }
+
+  private:
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	bool stopping = false;
+
+	void work();
+};
+
+// Leaves a core for the main thread
+u32 defaultWorkerCount();
@@ -108,8 +108,8 @@ void createUIPipeline(VulkanContext &context) {
 	createInfo.attributeDescriptionCount = 0;
 	createInfo.pAttributeDescriptions = nullptr;
 
-	context.createGraphicsPipeline(createInfo, context.uiPipeline,
-								   context.uiPipelineLayout);
+	context.pipelines.request(createInfo, &context.uiPipeline,
+							  &context.uiPipelineLayout);
 }
 
 void createUI(VulkanContext &context, UIContext *ui) {
@@ -0,0 +1,63 @@
+#include "UniformArena.h"
+#include "VulkanContext.h"
+
+#include <cstring>
+#include <stdexcept>
+
+internal_func VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+void UniformArena::init(VulkanContext *context, VkDeviceSize frameSize) {
+	this->context = context;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(context->physicalDevice, &properties);
+	alignment = properties.limits.minUniformBufferOffsetAlignment;
+	this->frameSize = alignUp(frameSize, alignment);
+
+	CreateBufferInfo createInfo{};
+	createInfo.size = this->frameSize * MAX_FRAMES_IN_FLIGHT;
+	createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	createInfo.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+							VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	createInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+		VMA_ALLOCATION_CREATE_MAPPED_BIT);
+	context->createBuffer(createInfo, buffer, allocation);
+
+	VmaAllocationInfo allocInfo = {};
+	vmaGetAllocationInfo(context->allocator, allocation, &allocInfo);
+	mapped = (u8 *)allocInfo.pMappedData;
+
+	frameStart = 0;
+	head = 0;
+}
+
+void UniformArena::beginFrame(u32 frame) {
+	frameStart = frame * frameSize;
+	head = 0;
+}
+
+u32 UniformArena::push(const void *data, VkDeviceSize size) {
+	if (head + size > frameSize) {
+		throw std::runtime_error("failed to fit uniforms in the frame's arena!");
+	}
+
+	VkDeviceSize offset = frameStart + head;
+	memcpy(mapped + offset, data, size);
+	head = alignUp(head + size, alignment);
+	return (u32)offset;
+}
+
+VkDescriptorBufferInfo UniformArena::descriptor(VkDeviceSize range) const {
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = range;
+	return bufferInfo;
+}
+
+void UniformArena::cleanup() {
+	vmaDestroyBuffer(context->allocator, buffer, allocation);
+}
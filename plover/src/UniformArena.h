@@ -0,0 +1,49 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "glfw.h"
+#include <vma/vk_mem_alloc.h>
+
+struct VulkanContext;
+
+// Bytes each frame in flight can allocate
+#define UNIFORM_ARENA_FRAME_SIZE (64 * 1024)
+
+// Every uniform written per frame, bump allocated from one persistently
+// mapped buffer. Each frame in flight owns a region of it, rewound when the
+// frame is written again. Bindings are VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+// over the whole buffer, an allocation's offset is the dynamic offset picking
+// it.
+//
+// NOTE: Recorded command buffers keep the offsets they were recorded with, so
+// a frame has to allocate the same uniforms in the same order every time.
+//
+// Main thread only.
+struct UniformArena {
+	VkBuffer buffer;
+	VmaAllocation allocation;
+
+	void init(VulkanContext *context, VkDeviceSize frameSize);
+
+	// Once the frame's fence has signaled
+	void beginFrame(u32 frame);
+	// Copies `size` bytes in, returns their dynamic offset
+	u32 push(const void *data, VkDeviceSize size);
+	template <typename T> u32 push(const T &value) {
+		return push(&value, sizeof(T));
+	}
+
+	// For a dynamic binding reading `range` bytes at a time
+	VkDescriptorBufferInfo descriptor(VkDeviceSize range) const;
+
+	void cleanup();
+
+  private:
+	VulkanContext *context;
+	u8 *mapped;
+	VkDeviceSize frameSize;
+	VkDeviceSize alignment; // minUniformBufferOffsetAlignment
+	VkDeviceSize frameStart;
+	VkDeviceSize head; // From frameStart
+};
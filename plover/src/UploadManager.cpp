@@ -0,0 +1,483 @@
+#include "UploadManager.h"
+#include "VulkanContext.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+// Staging offsets satisfy both buffer to image copies and block formats
+#define STAGING_ALIGNMENT 16
+
+void Upload::addBuffer(const void *source, VkDeviceSize size, VkBuffer buffer,
+					   VkDeviceSize offset) {
+	UploadChunk chunk{};
+	chunk.buffer = buffer;
+	for (VkDeviceSize done = 0; done < size; done += UPLOAD_CHUNK_SIZE) {
+		chunk.source = (const u8 *)source + done;
+		chunk.size = std::min<VkDeviceSize>(UPLOAD_CHUNK_SIZE, size - done);
+		chunk.bufferOffset = offset + done;
+		chunks.push_back(chunk);
+	}
+}
+
+void Upload::addImage(const void *source, VkImage image, u32 mipLevel,
+					  u32 baseLayer, u32 layers, VkExtent3D extent,
+					  VkDeviceSize rowSize, u32 blockHeight) {
+	u32 rows = (extent.height + blockHeight - 1) / blockHeight;
+	VkDeviceSize sliceSize = rows * rowSize;
+	// NOTE: 3D images can't have layers, so one of the two is always 1
+	u32 slices = layers * extent.depth;
+
+	UploadChunk chunk{};
+	chunk.image = image;
+	chunk.subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	chunk.subresource.mipLevel = mipLevel;
+	chunk.imageExtent.width = extent.width;
+
+	auto setSlices = [&](u32 first, u32 count) {
+		if (layers > 1) {
+			chunk.subresource.baseArrayLayer = baseLayer + first;
+			chunk.subresource.layerCount = count;
+			chunk.imageOffset.z = 0;
+			chunk.imageExtent.depth = 1;
+		} else {
+			chunk.subresource.baseArrayLayer = baseLayer;
+			chunk.subresource.layerCount = 1;
+			chunk.imageOffset.z = (i32)first;
+			chunk.imageExtent.depth = count;
+		}
+	};
+
+	if (sliceSize <= UPLOAD_CHUNK_SIZE) {
+		u32 slicesPerChunk = (u32)(UPLOAD_CHUNK_SIZE / sliceSize);
+		for (u32 slice = 0; slice < slices; slice += slicesPerChunk) {
+			u32 count = std::min(slicesPerChunk, slices - slice);
+			chunk.source = (const u8 *)source + slice * sliceSize;
+			chunk.size = count * sliceSize;
+			setSlices(slice, count);
+			chunk.imageOffset.y = 0;
+			chunk.imageExtent.height = extent.height;
+			chunks.push_back(chunk);
+		}
+		return;
+	}
+
+	u32 rowsPerChunk =
+		(u32)std::max<VkDeviceSize>(1, UPLOAD_CHUNK_SIZE / rowSize);
+	for (u32 slice = 0; slice < slices; slice++) {
+		for (u32 row = 0; row < rows; row += rowsPerChunk) {
+			u32 count = std::min(rowsPerChunk, rows - row);
+			chunk.source =
+				(const u8 *)source + slice * sliceSize + row * rowSize;
+			chunk.size = count * rowSize;
+			setSlices(slice, 1);
+			chunk.imageOffset.y = (i32)(row * blockHeight);
+			// The last row of blocks may hang over the edge
+			chunk.imageExtent.height =
+				std::min(count * blockHeight, extent.height - row * blockHeight);
+			chunks.push_back(chunk);
+		}
+	}
+}
+
+void UploadManager::init(VulkanContext *context) {
+	this->context = context;
+	queue = context->transferQueue;
+	budget.bytes = 16ull * 1024 * 1024;
+	budget.milliseconds = 2.0;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+					 VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = context->queueFamilies.transferFamily.value();
+	if (vkCreateCommandPool(context->device, &poolInfo, nullptr,
+							&commandPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+	if (vkCreateSemaphore(context->device, &semaphoreInfo, nullptr,
+						  &timeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload semaphore!");
+	}
+
+	CreateBufferInfo ringInfo{};
+	ringInfo.size = STAGING_RING_SIZE;
+	ringInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	ringInfo.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	ringInfo.vmaFlags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+						VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	context->createBuffer(ringInfo, ringBuffer, ringAllocation);
+
+	VmaAllocationInfo allocInfo{};
+	vmaGetAllocationInfo(context->allocator, ringAllocation, &allocInfo);
+	ringData = (u8 *)allocInfo.pMappedData;
+
+	nextTicket = 0;
+	recordedBytes = 0;
+	recordedMilliseconds = 0;
+	head = 0;
+	tail = 0;
+	used = 0;
+	recording = VK_NULL_HANDLE;
+	nextValue = 1;
+	completed = 0;
+}
+
+u64 UploadManager::schedule(Upload upload) {
+	u64 ticket = nextTicket++;
+	UploadPriority priority = upload.priority;
+	scheduled[{priority, ticket}] = {std::move(upload), 0};
+	return ticket;
+}
+
+void UploadManager::cancel(u64 ticket) {
+	for (auto it = scheduled.begin(); it != scheduled.end(); ++it) {
+		if (it->first.second == ticket) {
+			scheduled.erase(it);
+			return;
+		}
+	}
+}
+
+void UploadManager::uploadAndWait(Upload upload) {
+	ScheduledUpload now{std::move(upload), 0};
+	while (now.nextChunk < now.upload.chunks.size()) {
+		recordChunk(now, allocate(now.upload.chunks[now.nextChunk].size));
+	}
+	wait(submit());
+}
+
+VkCommandBuffer UploadManager::record() {
+	if (recording != VK_NULL_HANDLE) {
+		return recording;
+	}
+
+	if (freeCommandBuffers.empty()) {
+		VkCommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocateInfo.commandPool = commandPool;
+		allocateInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(context->device, &allocateInfo,
+									 &recording) != VK_SUCCESS) {
+			throw std::runtime_error(
+				"failed to allocate upload command buffer!");
+		}
+	} else {
+		recording = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(recording, &beginInfo);
+	return recording;
+}
+
+// Finds room for an allocation after the head, wrapping around to the start
+// of the ring if the end is too short
+bool UploadManager::fits(VkDeviceSize size, VkDeviceSize *offset) {
+	if (used == 0) {
+		head = 0;
+		tail = 0;
+	}
+
+	VkDeviceSize aligned =
+		(head + STAGING_ALIGNMENT - 1) & ~(VkDeviceSize)(STAGING_ALIGNMENT - 1);
+	if (head > tail || used == 0) {
+		if (aligned + size <= STAGING_RING_SIZE) {
+			*offset = aligned;
+		} else if (size <= tail) {
+			*offset = 0;
+		} else {
+			return false;
+		}
+	} else if (head < tail && aligned + size <= tail) {
+		*offset = aligned;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Staging for a chunk of the current batch, without waiting on the GPU
+bool UploadManager::tryAllocate(VkDeviceSize size,
+								StagingAllocation *allocation) {
+	VkDeviceSize offset;
+	if (!fits(size, &offset)) {
+		reclaim();
+		if (!fits(size, &offset)) {
+			return false;
+		}
+	}
+
+	// The padding skipped to align, or to wrap around, is charged to the
+	// region so it comes back when the region is freed
+	RingRegion region{};
+	region.size =
+		(offset >= head ? offset - head : STAGING_RING_SIZE - head + offset) +
+		size;
+	region.value = nextValue;
+	regions.push_back(region);
+	head = (offset + size) % STAGING_RING_SIZE;
+	used += region.size;
+
+	allocation->buffer = ringBuffer;
+	allocation->offset = offset;
+	allocation->data = ringData + offset;
+	return true;
+}
+
+// Like tryAllocate, but waits for the ring to free up. Chunks larger than the
+// whole ring get a buffer of their own.
+StagingAllocation UploadManager::allocate(VkDeviceSize size) {
+	StagingAllocation allocation{};
+
+	if (size > STAGING_RING_SIZE) {
+		RingRegion region{};
+		region.value = nextValue;
+
+		CreateBufferInfo dedicatedInfo{};
+		dedicatedInfo.size = size;
+		dedicatedInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		dedicatedInfo.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+								   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		dedicatedInfo.vmaFlags =
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+			VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		context->createBuffer(dedicatedInfo, region.dedicatedBuffer,
+							  region.dedicatedAllocation);
+		regions.push_back(region);
+
+		VmaAllocationInfo allocInfo{};
+		vmaGetAllocationInfo(context->allocator, region.dedicatedAllocation,
+							 &allocInfo);
+		allocation.buffer = region.dedicatedBuffer;
+		allocation.offset = 0;
+		allocation.data = (u8 *)allocInfo.pMappedData;
+		return allocation;
+	}
+
+	while (!tryAllocate(size, &allocation)) {
+		// NOTE: Regions are freed in order, so the oldest one is what holds
+		// the ring up. It may be in the batch still being recorded.
+		u64 value = regions.front().value;
+		if (value == nextValue) {
+			submit();
+		}
+		wait(value);
+	}
+	return allocation;
+}
+
+// Writes the next chunk of an upload to `staging` and records its copy
+void UploadManager::recordChunk(ScheduledUpload &scheduled,
+								StagingAllocation staging) {
+	Upload &upload = scheduled.upload;
+	UploadChunk &chunk = upload.chunks[scheduled.nextChunk];
+	VkCommandBuffer commandBuffer = record();
+
+	if (scheduled.nextChunk == 0) {
+		for (UploadImage &image : upload.images) {
+			context->recordImageLayoutTransition(
+				commandBuffer, image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, image.layers,
+				image.mipLevels);
+		}
+	}
+
+	memcpy(staging.data, chunk.source, chunk.size);
+	if (chunk.image == VK_NULL_HANDLE) {
+		VkBufferCopy region{staging.offset, chunk.bufferOffset, chunk.size};
+		vkCmdCopyBuffer(commandBuffer, staging.buffer, chunk.buffer, 1,
+						&region);
+	} else {
+		VkBufferImageCopy region{};
+		region.bufferOffset = staging.offset;
+		region.imageSubresource = chunk.subresource;
+		region.imageOffset = chunk.imageOffset;
+		region.imageExtent = chunk.imageExtent;
+		vkCmdCopyBufferToImage(commandBuffer, staging.buffer, chunk.image,
+							   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+							   &region);
+	}
+
+	scheduled.nextChunk++;
+	if (scheduled.nextChunk < upload.chunks.size()) {
+		return;
+	}
+
+	for (UploadImage &image : upload.images) {
+		context->recordImageLayoutTransition(
+			commandBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, image.layers,
+			image.mipLevels);
+	}
+	if (upload.onRecorded) {
+		upload.onRecorded(nextValue);
+	}
+}
+
+u64 UploadManager::submit() {
+	if (recording == VK_NULL_HANDLE) {
+		return nextValue - 1;
+	}
+	vkEndCommandBuffer(recording);
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &nextValue;
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &recording;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timeline;
+	if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit upload command buffer!");
+	}
+
+	inFlight.push_back({recording, nextValue});
+	recording = VK_NULL_HANDLE;
+	return nextValue++;
+}
+
+bool UploadManager::isComplete(u64 value) {
+	if (value > completed) {
+		vkGetSemaphoreCounterValue(context->device, timeline, &completed);
+	}
+	return value <= completed;
+}
+
+void UploadManager::wait(u64 value) {
+	if (value <= completed) {
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timeline;
+	waitInfo.pValues = &value;
+	vkWaitSemaphores(context->device, &waitInfo, UINT64_MAX);
+	completed = value;
+}
+
+// Frees the oldest regions whose batch completed
+void UploadManager::reclaim() {
+	isComplete(nextValue - 1);
+
+	while (!regions.empty() && regions.front().value <= completed) {
+		RingRegion &region = regions.front();
+		if (region.dedicatedBuffer != VK_NULL_HANDLE) {
+			vmaDestroyBuffer(context->allocator, region.dedicatedBuffer,
+							 region.dedicatedAllocation);
+		} else {
+			tail = (tail + region.size) % STAGING_RING_SIZE;
+			used -= region.size;
+		}
+		regions.pop_front();
+	}
+}
+
+void UploadManager::update() {
+	// NOTE: Never waits on the GPU, a full ring just leaves the rest of the
+	// queue to the next frames
+	f64 start = glfwGetTime();
+	recordedBytes = 0;
+	while (!scheduled.empty()) {
+		ScheduledUpload &next = scheduled.begin()->second;
+		if (next.nextChunk == next.upload.chunks.size()) {
+			// Nothing to copy
+			if (next.upload.onRecorded) {
+				next.upload.onRecorded(nextValue);
+			}
+			scheduled.erase(scheduled.begin());
+			continue;
+		}
+
+		VkDeviceSize size = next.upload.chunks[next.nextChunk].size;
+		f64 elapsed = (glfwGetTime() - start) * 1000.0;
+		if (recordedBytes > 0 && (recordedBytes + size > budget.bytes ||
+								  elapsed >= budget.milliseconds)) {
+			break;
+		}
+
+		StagingAllocation staging;
+		if (size > STAGING_RING_SIZE) {
+			staging = allocate(size);
+		} else if (!tryAllocate(size, &staging)) {
+			break;
+		}
+		recordChunk(next, staging);
+		recordedBytes += size;
+
+		if (next.nextChunk == next.upload.chunks.size()) {
+			scheduled.erase(scheduled.begin());
+		}
+	}
+	recordedMilliseconds = (glfwGetTime() - start) * 1000.0;
+
+	submit();
+	isComplete(nextValue - 1);
+	for (auto batch = inFlight.begin(); batch != inFlight.end();) {
+		if (batch->value > completed) {
+			++batch;
+			continue;
+		}
+		freeCommandBuffers.push_back(batch->commandBuffer);
+		batch = inFlight.erase(batch);
+	}
+	reclaim();
+}
+
+UploadStats UploadManager::stats() const {
+	UploadStats stats{};
+	stats.queuedUploads = (u32)scheduled.size();
+	for (auto &kv : scheduled) {
+		const ScheduledUpload &upload = kv.second;
+		for (size_t i = upload.nextChunk; i < upload.upload.chunks.size();
+			 i++) {
+			stats.queuedChunks++;
+			stats.queuedBytes += upload.upload.chunks[i].size;
+		}
+	}
+	stats.recordedBytes = recordedBytes;
+	stats.recordedMilliseconds = recordedMilliseconds;
+	return stats;
+}
+
+void UploadManager::cleanup() {
+	scheduled.clear();
+	wait(submit());
+	reclaim();
+
+	for (Batch &batch : inFlight) {
+		freeCommandBuffers.push_back(batch.commandBuffer);
+	}
+	inFlight.clear();
+	if (!freeCommandBuffers.empty()) {
+		vkFreeCommandBuffers(context->device, commandPool,
+							 freeCommandBuffers.size(),
+							 freeCommandBuffers.data());
+	}
+	freeCommandBuffers.clear();
+
+	vkDestroyCommandPool(context->device, commandPool, nullptr);
+	vkDestroySemaphore(context->device, timeline, nullptr);
+	vmaDestroyBuffer(context->allocator, ringBuffer, ringAllocation);
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <plover/plover.h>
+
+#include "glfw.h"
+#include <vma/vk_mem_alloc.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+struct VulkanContext;
+
+#define STAGING_RING_SIZE (64ull * 1024 * 1024)
+// Largest piece of an upload staged and copied at once
+#define UPLOAD_CHUNK_SIZE (4ull * 1024 * 1024)
+
+enum UploadPriority {
+	UPLOAD_PRIORITY_HIGH,
+	UPLOAD_PRIORITY_NORMAL,
+	UPLOAD_PRIORITY_LOW,
+};
+
+// A single copy, into a buffer when `image` is null
+struct UploadChunk {
+	const u8 *source;
+	VkDeviceSize size;
+
+	VkBuffer buffer;
+	VkDeviceSize bufferOffset;
+
+	VkImage image;
+	VkImageSubresourceLayers subresource;
+	VkOffset3D imageOffset;
+	VkExtent3D imageExtent;
+};
+
+// Moved to TRANSFER_DST before an upload's first chunk, and to
+// SHADER_READ_ONLY after its last
+struct UploadImage {
+	VkImage image;
+	u32 layers;
+	u32 mipLevels;
+};
+
+// Data to copy to device buffers and images, split into chunks so it can be
+// spread over several frames
+struct Upload {
+	UploadPriority priority = UPLOAD_PRIORITY_NORMAL;
+	std::vector<UploadChunk> chunks;
+	std::vector<UploadImage> images;
+	// Keeps the chunks' source memory alive until they are all recorded
+	std::shared_ptr<const void> source;
+	// Called once the last chunk is recorded, with the timeline value its
+	// batch signals
+	std::function<void(u64 value)> onRecorded;
+
+	void addBuffer(const void *source, VkDeviceSize size, VkBuffer buffer,
+				   VkDeviceSize offset = 0);
+	// Adds a mip level of `layers` layers laid out one after the other, with
+	// `rowSize` bytes per row of texel blocks `blockHeight` texels high. Large
+	// levels are split by layers, depth slices, then rows.
+	void addImage(const void *source, VkImage image, u32 mipLevel,
+				  u32 baseLayer, u32 layers, VkExtent3D extent,
+				  VkDeviceSize rowSize, u32 blockHeight);
+};
+
+// How much the scheduler records per frame. At least one chunk is always
+// recorded, so nothing starves.
+struct UploadBudget {
+	VkDeviceSize bytes;
+	f64 milliseconds;
+};
+
+// Where a chunk's data is written before being copied to the device
+struct StagingAllocation {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	u8 *data; // Mapped, write only
+};
+
+// Schedules uploads by priority and records a few chunks of them per frame,
+// up to a byte and time budget, so streaming content never hitches a frame.
+// Chunks are staged through one persistent mapped ring buffer and recorded
+// into a single command buffer, submitted once per frame on the transfer
+// queue. Completion is tracked with a timeline semaphore, which the frame's
+// draw waits on, so nothing ever waits for a queue to go idle.
+//
+// Main thread only. Uploads can be built anywhere.
+struct UploadManager {
+	VkSemaphore timeline;
+	UploadBudget budget;
+
+	void init(VulkanContext *context);
+
+	// Queues an upload, returns a ticket to cancel it with
+	u64 schedule(Upload upload);
+	// Drops what's left of a queued upload. Chunks already recorded still
+	// complete.
+	void cancel(u64 ticket);
+	// Records a whole upload right away, ignoring the budget, and waits for it
+	void uploadAndWait(Upload upload);
+
+	// Submits the current batch, if anything was recorded, and returns the
+	// value it will signal
+	u64 submit();
+	bool isComplete(u64 value);
+	void wait(u64 value);
+	// Highest value seen completed. Draws wait on it, which makes everything
+	// handed over so far visible to them.
+	u64 completedValue() const { return completed; }
+
+	// Once per frame, records queued chunks up to the budget, submits them and
+	// reclaims finished batches
+	void update();
+	UploadStats stats() const;
+	void cleanup();
+
+  private:
+	struct ScheduledUpload {
+		Upload upload;
+		size_t nextChunk;
+	};
+
+	struct RingRegion {
+		VkDeviceSize size; // Includes the padding wasted before it
+		u64 value;		   // Of the batch reading it
+		VkBuffer dedicatedBuffer; // Only for chunks larger than the ring
+		VmaAllocation dedicatedAllocation;
+	};
+
+	struct Batch {
+		VkCommandBuffer commandBuffer;
+		u64 value;
+	};
+
+	VulkanContext *context;
+	VkQueue queue;
+	VkCommandPool commandPool;
+
+	// By priority, then in the order they were scheduled
+	std::map<std::pair<UploadPriority, u64>, ScheduledUpload> scheduled;
+	u64 nextTicket;
+	// Last frame's
+	VkDeviceSize recordedBytes;
+	f64 recordedMilliseconds;
+
+	VkBuffer ringBuffer;
+	VmaAllocation ringAllocation;
+	u8 *ringData;
+	std::deque<RingRegion> regions; // Oldest first
+	VkDeviceSize head;
+	VkDeviceSize tail;
+	VkDeviceSize used;
+
+	VkCommandBuffer recording;
+	u64 nextValue;
+	u64 completed;
+	std::vector<Batch> inFlight;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+
+	VkCommandBuffer record();
+	bool fits(VkDeviceSize size, VkDeviceSize *offset);
+	bool tryAllocate(VkDeviceSize size, StagingAllocation *allocation);
+	StagingAllocation allocate(VkDeviceSize size);
+	void recordChunk(ScheduledUpload &upload, StagingAllocation staging);
+	void reclaim();
+};
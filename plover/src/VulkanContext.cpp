@@ -2,10 +2,12 @@
 #include "Mesh.h"
 #include "plover_int.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <vulkan/vulkan_core.h>
 
 #pragma clang diagnostic push
@@ -252,6 +254,20 @@ VulkanContext::findQueueFamilies(VkPhysicalDevice currentDevice) {
 		i++;
 	}
 
+	// Transfer only families are usually backed by the copy engines, which
+	// run alongside rendering
+	for (uint32_t j = 0; j < queueFamilyCount; j++) {
+		VkQueueFlags flags = queueFamilies[j].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) &&
+			!(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			indices.transferFamily = j;
+			break;
+		}
+	}
+	if (!indices.transferFamily.has_value()) {
+		indices.transferFamily = indices.graphicsFamily;
+	}
+
 	return indices;
 }
 
@@ -341,7 +357,32 @@ uint32_t VulkanContext::rateDeviceSuitability(VkPhysicalDevice currentDevice) {
 							!swapChainSupport.presentModes.empty();
 	}
 
-	if (!(indices.isComplete() && extensionsSupported && swapChainAdequate)) {
+	// Uploads are tracked with timeline semaphores
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 features2{};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &features12;
+	bool timelineSupported =
+		deviceDetails.properties.apiVersion >= VK_API_VERSION_1_2;
+	if (timelineSupported) {
+		vkGetPhysicalDeviceFeatures2(currentDevice, &features2);
+		timelineSupported = features12.timelineSemaphore;
+	}
+
+	// Mesh draws find their instances through firstInstance
+	bool firstInstanceSupported =
+		deviceDetails.features.drawIndirectFirstInstance;
+
+	// Materials sample a bindless texture table, see MaterialTable
+	bool bindlessSupported =
+		timelineSupported && features12.runtimeDescriptorArray &&
+		features12.descriptorBindingPartiallyBound &&
+		features12.descriptorBindingSampledImageUpdateAfterBind &&
+		features12.shaderSampledImageArrayNonUniformIndexing;
+
+	if (!(indices.isComplete() && extensionsSupported && swapChainAdequate &&
+		  timelineSupported && firstInstanceSupported && bindlessSupported)) {
 		return 0;
 	}
 
@@ -378,7 +419,8 @@ void VulkanContext::createLogicalDevice() {
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	// These might be the same
 	std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(),
-											  indices.presentFamily.value()};
+											  indices.presentFamily.value(),
+											  indices.transferFamily.value()};
 
 	float queuePriority = 1.0f;
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -400,6 +442,12 @@ void VulkanContext::createLogicalDevice() {
 	if (supportedFeatures.fillModeNonSolid) {
 		deviceFeatures.fillModeNonSolid = VK_TRUE;
 	}
+	if (supportedFeatures.textureCompressionBC) {
+		deviceFeatures.textureCompressionBC = VK_TRUE;
+	}
+	deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+	multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
 
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -410,6 +458,30 @@ void VulkanContext::createLogicalDevice() {
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
+	VkPhysicalDeviceVulkan12Features supported12{};
+	supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supported2{};
+	supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supported2.pNext = &supported12;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supported2);
+
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.timelineSemaphore = VK_TRUE;
+	features12.runtimeDescriptorArray = VK_TRUE;
+	features12.descriptorBindingPartiallyBound = VK_TRUE;
+	features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	// Compute passes are slow on software devices, they cull on the host
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	culling.onHost = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+	// Otherwise culled draws are still issued, with no instances
+	culling.drawIndirectCount =
+		!culling.onHost && supported12.drawIndirectCount;
+	features12.drawIndirectCount = culling.drawIndirectCount;
+	createInfo.pNext = &features12;
+
 	createInfo.enabledExtensionCount =
 		static_cast<uint32_t>(deviceExtensions.size());
 	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
@@ -430,6 +502,9 @@ void VulkanContext::createLogicalDevice() {
 
 	vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+	vkGetDeviceQueue(device, indices.transferFamily.value(), 0,
+					 &transferQueue);
+	queueFamilies = indices;
 }
 
 void VulkanContext::initAllocator() {
@@ -451,6 +526,17 @@ void VulkanContext::createBuffer(CreateBufferInfo createInfo, VkBuffer &buffer,
 	bufferInfo.usage = createInfo.usage;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+	// NOTE: Uploads are copied on the transfer queue, sharing them avoids
+	// having to transfer their ownership to the graphics queue
+	uint32_t families[] = {queueFamilies.graphicsFamily.value(),
+						   queueFamilies.transferFamily.value()};
+	if ((createInfo.usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) &&
+		families[0] != families[1]) {
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = 2;
+		bufferInfo.pQueueFamilyIndices = families;
+	}
+
 	VmaAllocationCreateInfo allocCreateInfo = {};
 	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
 	allocCreateInfo.requiredFlags = createInfo.properties;
@@ -468,7 +554,7 @@ void VulkanContext::createImage(CreateImageInfo createInfo, VkImage &image,
 	imageInfo.extent.width = createInfo.width;
 	imageInfo.extent.height = createInfo.height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = createInfo.mipLevels;
 	imageInfo.arrayLayers = createInfo.layers;
 	imageInfo.format = createInfo.format;
 	imageInfo.tiling = createInfo.tiling;
@@ -477,6 +563,16 @@ void VulkanContext::createImage(CreateImageInfo createInfo, VkImage &image,
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+	// NOTE: See createBuffer
+	uint32_t families[] = {queueFamilies.graphicsFamily.value(),
+						   queueFamilies.transferFamily.value()};
+	if ((createInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) &&
+		families[0] != families[1]) {
+		imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		imageInfo.queueFamilyIndexCount = 2;
+		imageInfo.pQueueFamilyIndices = families;
+	}
+
 	VmaAllocationCreateInfo allocCreateInfo = {};
 	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
 	allocCreateInfo.requiredFlags = createInfo.properties;
@@ -634,8 +730,8 @@ void VulkanContext::createImageView(CreateImageViewInfo createInfo,
 	imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 
 	imageViewInfo.subresourceRange.aspectMask = createInfo.aspectFlags;
-	imageViewInfo.subresourceRange.baseMipLevel = 0; // no mipmaps
-	imageViewInfo.subresourceRange.levelCount = 1;
+	imageViewInfo.subresourceRange.baseMipLevel = createInfo.baseMipLevel;
+	imageViewInfo.subresourceRange.levelCount = createInfo.mipLevels;
 	imageViewInfo.subresourceRange.baseArrayLayer = 0;
 	imageViewInfo.subresourceRange.layerCount = createInfo.layers;
 
@@ -659,26 +755,6 @@ void VulkanContext::createImageViews() {
 	}
 }
 
-std::vector<char> readFile(const std::string &filename) {
-	std::cout << filename << std::endl;
-
-	// Open at end so we can get position for filesize
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error("failed to open file");
-	}
-
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-
-	file.close();
-	return buffer;
-}
-
 void VulkanContext::createRenderPass() {
 	VkAttachmentDescription colorAttachment{};
 	colorAttachment.format = swapChainImageFormat;
@@ -698,12 +774,13 @@ void VulkanContext::createRenderPass() {
 	depthAttachment.format = findDepthFormat();
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	// Kept for the depth pyramid, see DepthPyramid
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	depthAttachment.finalLayout =
-		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
 	VkAttachmentReference depthAttachmentRef{};
 	depthAttachmentRef.attachment = 1;
@@ -728,14 +805,16 @@ void VulkanContext::createRenderPass() {
 	subpasses[1].pDepthStencilAttachment = nullptr;
 
 	// Ensure render pass depends on color attachment
-	VkSubpassDependency dependencies[2];
+	VkSubpassDependency dependencies[3];
 	dependencies[0] = {};
 	dependencies[0].srcSubpass =
 		VK_SUBPASS_EXTERNAL; // Implicit subpass before render
 	dependencies[0].dstSubpass = 0;
+	// NOTE: The last depth pyramid build read the depth attachment
 	dependencies[0].srcStageMask =
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 	dependencies[0].srcAccessMask = 0;
 	dependencies[0].dstStageMask =
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
@@ -760,6 +839,17 @@ void VulkanContext::createRenderPass() {
 		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
 		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+	// The depth pyramid is built from the forward pass' depth
+	dependencies[2] = {};
+	dependencies[2].srcSubpass = 0;
+	dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[2].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+								   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[2].srcAccessMask =
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
 	std::array<VkAttachmentDescription, 2> attachments = {colorAttachment,
 														  depthAttachment};
 	VkRenderPassCreateInfo renderPassInfo{};
@@ -768,7 +858,7 @@ void VulkanContext::createRenderPass() {
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 2;
 	renderPassInfo.pSubpasses = subpasses;
-	renderPassInfo.dependencyCount = 2;
+	renderPassInfo.dependencyCount = 3;
 	renderPassInfo.pDependencies = dependencies;
 
 	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) !=
@@ -780,7 +870,8 @@ void VulkanContext::createRenderPass() {
 void VulkanContext::createGlobalDescriptorSetLayout() {
 	VkDescriptorSetLayoutBinding uboLayoutBinding{};
 	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType =
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount = 1;
 	uboLayoutBinding.stageFlags =
 		VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
@@ -824,202 +915,6 @@ VulkanContext::createShaderModule(const std::vector<char> &code) {
 	return shaderModule;
 }
 
-void VulkanContext::createGraphicsPipeline(PipelineCreateInfo info,
-										   VkPipeline &pipeline,
-										   VkPipelineLayout &pipelineLayout) {
-	std::vector<char> vertShaderCode = readFile(info.vertexShaderPath);
-	std::vector<char> fragShaderCode = readFile(info.fragmentShaderPath);
-
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-	vertShaderStageInfo.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-	fragShaderStageInfo.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
-													  fragShaderStageInfo};
-
-	std::vector<VkDynamicState> dynamicStates = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-	};
-
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount =
-		static_cast<uint32_t>(dynamicStates.size());
-	dynamicState.pDynamicStates = dynamicStates.data();
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-	vertexInputInfo.vertexBindingDescriptionCount =
-		info.bindingDescriptionCount;
-	vertexInputInfo.pVertexBindingDescriptions = info.pBindingDescriptions;
-	vertexInputInfo.vertexAttributeDescriptionCount =
-		info.attributeDescriptionCount;
-	vertexInputInfo.pVertexAttributeDescriptions = info.pAttributeDescriptions;
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	// We are drawing triangles
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)swapChainExtent.width;
-	viewport.height = (float)swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor{};
-	scissor.offset = {0, 0};
-	scissor.extent = swapChainExtent;
-
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	if (info.wireframeMode) {
-		rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
-	} else {
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	}
-	rasterizer.lineWidth = 1.0f; // Any larger requires wideLines GPU feature
-	if (info.doCulling) {
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	} else {
-		rasterizer.cullMode = VK_CULL_MODE_NONE;
-	}
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	// We don't need depth biasing
-	rasterizer.depthBiasEnable = VK_FALSE;
-	rasterizer.depthBiasConstantFactor = 0.0f;
-	rasterizer.depthBiasClamp = 0.0f;
-	rasterizer.depthBiasSlopeFactor = 0.0f;
-
-	// Multisampling is disabled for now
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampling.pSampleMask = nullptr;
-	multisampling.alphaToCoverageEnable = VK_FALSE;
-	multisampling.alphaToOneEnable = VK_FALSE;
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask =
-		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-	colorBlendAttachment.blendEnable = VK_TRUE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colorBlendAttachment.dstColorBlendFactor =
-		VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-	// Global blend settings
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f;
-	colorBlending.blendConstants[1] = 0.0f;
-	colorBlending.blendConstants[2] = 0.0f;
-	colorBlending.blendConstants[3] = 0.0f;
-
-	// Uniform vector setup
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = info.descriptorSetLayoutCount;
-	pipelineLayoutInfo.pSetLayouts = info.pDescriptorSetLayouts;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
-							   &pipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
-
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	if (info.useDepthBuffer) {
-		depthStencil.depthTestEnable = VK_TRUE;
-		depthStencil.depthWriteEnable = VK_TRUE;
-		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-		depthStencil.depthBoundsTestEnable = VK_FALSE;
-		depthStencil.minDepthBounds = 0.0f;
-		depthStencil.maxDepthBounds = 1.0f;
-		depthStencil.stencilTestEnable = VK_FALSE;
-		depthStencil.front = {};
-		depthStencil.back = {};
-	} else {
-		depthStencil.depthTestEnable = VK_FALSE;
-	}
-
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = &depthStencil;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = &dynamicState;
-
-	pipelineInfo.layout = pipelineLayout;
-
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = info.subpass;
-
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-	pipelineInfo.basePipelineIndex = -1;
-
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-								  nullptr, &pipeline) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create graphics pipeline!");
-	}
-
-	vkDestroyShaderModule(device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(device, vertShaderModule, nullptr);
-}
-
 void VulkanContext::createWireframePipeline() {
 	VkDescriptorSetLayout descriptorSetLayouts[2] = {globalDescriptorSetLayout,
 													 meshDescriptorSetLayout};
@@ -1042,8 +937,8 @@ void VulkanContext::createWireframePipeline() {
 	pipelineInfo.attributeDescriptionCount = attributeDescriptions.size();
 	pipelineInfo.pAttributeDescriptions = attributeDescriptions.data();
 
-	createGraphicsPipeline(pipelineInfo, wireframePipeline,
-						   wireframePipelineLayout);
+	pipelines.request(pipelineInfo, &wireframePipeline,
+					  &wireframePipelineLayout);
 }
 
 void VulkanContext::createFramebuffers() {
@@ -1089,18 +984,13 @@ void VulkanContext::createCommandPool(VkCommandPoolCreateFlagBits flags,
 void VulkanContext::createCommandPools() {
 	createCommandPool(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
 					  drawCommandPool);
-	VkCommandPoolCreateFlagBits copyFlags =
-		static_cast<VkCommandPoolCreateFlagBits>(
-			VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
-			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
-	createCommandPool(copyFlags, transientCommandPool);
 }
 
-void VulkanContext::transitionImageLayout(VkImage image, VkFormat format,
-										  VkImageLayout oldLayout,
-										  VkImageLayout newLayout, u32 layers) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
+void VulkanContext::recordImageLayoutTransition(VkCommandBuffer commandBuffer,
+												VkImage image,
+												VkImageLayout oldLayout,
+												VkImageLayout newLayout,
+												u32 layers, u32 mipLevels) {
 	VkImageMemoryBarrier barrier{};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = oldLayout;
@@ -1110,7 +1000,7 @@ void VulkanContext::transitionImageLayout(VkImage image, VkFormat format,
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = layers;
 
@@ -1126,48 +1016,19 @@ void VulkanContext::transitionImageLayout(VkImage image, VkFormat format,
 		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 	} else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
 			   newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+		// NOTE: Recorded on the transfer queue, which has no shader stages.
+		// Draws wait on the upload timeline, which makes the copy visible.
 		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = 0;
 
 		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 	} else {
 		throw std::invalid_argument("unsupported layout transition!");
 	}
 
 	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0,
 						 nullptr, 0, nullptr, 1, &barrier);
-
-	endSingleTimeCommands(commandBuffer);
-}
-
-void VulkanContext::copyBufferToImage(VkBuffer buffer, VkImage image, u32 width,
-									  u32 height, u32 imageSize, u32 layers) {
-	copyBufferToImage(buffer, image, width, height, 1, imageSize, layers);
-}
-
-void VulkanContext::copyBufferToImage(VkBuffer buffer, VkImage image, u32 width,
-									  u32 height, u32 depth, u32 imageSize,
-									  u32 layers) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkBufferImageCopy region{};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = layers;
-
-	region.imageOffset = {0, 0, 0};
-	region.imageExtent = {width, height, depth};
-
-	vkCmdCopyBufferToImage(commandBuffer, buffer, image,
-						   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-	endSingleTimeCommands(commandBuffer);
 }
 
 VkFormat
@@ -1195,7 +1056,8 @@ VkFormat VulkanContext::findDepthFormat() {
 								 VK_FORMAT_D32_SFLOAT_S8_UINT,
 								 VK_FORMAT_D24_UNORM_S8_UINT},
 								VK_IMAGE_TILING_OPTIMAL,
-								VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+								VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+									VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 }
 
 bool hasStencilComponent(VkFormat format) {
@@ -1212,7 +1074,8 @@ void VulkanContext::createDepthResources() {
 	imageInfo.format = depthFormat;
 	imageInfo.layers = 1;
 	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+					  VK_IMAGE_USAGE_SAMPLED_BIT;
 	imageInfo.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 	imageInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(0);
 
@@ -1227,111 +1090,128 @@ void VulkanContext::createDepthResources() {
 	createImageView(imageViewInfo, &depthImageView);
 }
 
-VkCommandBuffer VulkanContext::beginSingleTimeCommands() {
-	VkCommandBufferAllocateInfo allocateInfo{};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocateInfo.commandPool = transientCommandPool;
-	allocateInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer);
-
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	return commandBuffer;
+void VulkanContext::uploadBuffer(const void *data, VkDeviceSize size,
+								 VkBuffer dstBuffer) {
+	Upload upload{};
+	upload.priority = UPLOAD_PRIORITY_HIGH;
+	upload.addBuffer(data, size, dstBuffer);
+	uploads.uploadAndWait(upload);
 }
 
-void VulkanContext::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	// TODO: Probably want to use a fence once multiple buffer copies are
-	// necessary
-	vkQueueWaitIdle(graphicsQueue);
-	vkFreeCommandBuffers(device, transientCommandPool, 1, &commandBuffer);
+void VulkanContext::createUniformBuffers() {
+	uniforms.init(this, UNIFORM_ARENA_FRAME_SIZE);
 }
 
-void VulkanContext::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
-							   VkDeviceSize size) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+void VulkanContext::createDescriptorAllocator() {
+	descriptorAllocator.init(device);
+}
 
-	VkBufferCopy copyRegion{};
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+void VulkanContext::createGlobalDescriptorSet() {
+	descriptorAllocator.allocate(1, &globalDescriptorSet,
+								 globalDescriptorSetLayout);
 
-	endSingleTimeCommands(commandBuffer);
+	VkDescriptorBufferInfo bufferInfo =
+		uniforms.descriptor(sizeof(GlobalUniform));
+
+	VkWriteDescriptorSet descriptorWrite{};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = globalDescriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+	descriptorWrite.pImageInfo = nullptr;
+	descriptorWrite.pTexelBufferView = nullptr;
+
+	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 }
 
-void VulkanContext::createUniformBuffers() {
-	VkDeviceSize bufferSize = sizeof(GlobalUniform);
-
-	uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+void VulkanContext::createDrawBuffers() {
+	meshInstanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	meshInstanceBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+	meshInstanceBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	indirectBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	indirectBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+	indirectBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 		CreateBufferInfo createInfo{};
-		createInfo.size = bufferSize;
-		createInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		createInfo.size = MAX_MESH_INSTANCES * sizeof(MeshInstance);
+		createInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 		createInfo.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 								VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 		createInfo.vmaFlags = static_cast<VmaAllocationCreateFlagBits>(
 			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
 			VMA_ALLOCATION_CREATE_MAPPED_BIT);
 
-		// TODO Fix Persistent mapping
 		VmaAllocationInfo allocInfo = {};
-		createBuffer(createInfo, uniformBuffers[i],
-					 uniformBuffersAllocations[i]);
-		vmaGetAllocationInfo(allocator, uniformBuffersAllocations[i],
+		createBuffer(createInfo, meshInstanceBuffers[i],
+					 meshInstanceBuffersAllocations[i]);
+		vmaGetAllocationInfo(allocator, meshInstanceBuffersAllocations[i],
+							 &allocInfo);
+		meshInstanceBuffersMapped[i] = allocInfo.pMappedData;
+
+		// NOTE: Mesh draws are read by the culling pass, the UI's drawn
+		createInfo.size = UI_DRAW_OFFSET + sizeof(VkDrawIndirectCommand);
+		createInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+						   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		createBuffer(createInfo, indirectBuffers[i],
+					 indirectBuffersAllocations[i]);
+		vmaGetAllocationInfo(allocator, indirectBuffersAllocations[i],
 							 &allocInfo);
-		uniformBuffersMapped[i] = allocInfo.pMappedData;
+		indirectBuffersMapped[i] = allocInfo.pMappedData;
 	}
-}
 
-void VulkanContext::createDescriptorAllocator() {
-	descriptorAllocator.init(device);
-}
+	// NOTE: Nothing is recorded yet
+	recordedVersions.assign(MAX_FRAMES_IN_FLIGHT, UINT64_MAX);
+	recordedImages.assign(MAX_FRAMES_IN_FLIGHT, 0);
+	recordedInstances.resize(MAX_FRAMES_IN_FLIGHT);
+	recordedDraws.resize(MAX_FRAMES_IN_FLIGHT);
+
+	culling.init(this);
 
-void VulkanContext::createGlobalDescriptorSets() {
-	globalDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+	meshDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
 	descriptorAllocator.allocate(MAX_FRAMES_IN_FLIGHT,
-								 globalDescriptorSets.data(),
-								 globalDescriptorSetLayout);
+								 meshDescriptorSets.data(),
+								 meshDescriptorSetLayout);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = uniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(GlobalUniform);
-
-		VkWriteDescriptorSet descriptorWrite{};
-		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.dstSet = globalDescriptorSets[i];
-		descriptorWrite.dstBinding = 0;
-		descriptorWrite.dstArrayElement = 0;
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrite.descriptorCount = 1;
-		descriptorWrite.pBufferInfo = &bufferInfo;
-		descriptorWrite.pImageInfo = nullptr;
-		descriptorWrite.pTexelBufferView = nullptr;
-
-		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+		std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+		bufferInfos[0].buffer = meshInstanceBuffers[i];
+		bufferInfos[0].offset = 0;
+		bufferInfos[0].range = VK_WHOLE_SIZE;
+		bufferInfos[1].buffer = culling.frames[i].visible.buffer;
+		bufferInfos[1].offset = 0;
+		bufferInfos[1].range = VK_WHOLE_SIZE;
+
+		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+		for (u32 binding = 0; binding < 2; binding++) {
+			VkWriteDescriptorSet &descriptorWrite = descriptorWrites[binding];
+			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrite.dstSet = meshDescriptorSets[i];
+			descriptorWrite.dstBinding = binding;
+			descriptorWrite.dstArrayElement = 0;
+			descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrite.descriptorCount = 1;
+			descriptorWrite.pBufferInfo = &bufferInfos[binding];
+		}
+
+		vkUpdateDescriptorSets(device, (u32)descriptorWrites.size(),
+							   descriptorWrites.data(), 0, nullptr);
 	}
 }
 
+// With the swap chain, the pyramid follows the depth attachment's size
+void VulkanContext::createDepthPyramid() {
+	if (culling.onHost) {
+		return;
+	}
+
+	depthPyramid.create(swapChainExtent, depthImageView);
+	culling.bindPyramid(depthPyramid);
+}
+
 void VulkanContext::createCommandBuffer() {
 	commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 	VkCommandBufferAllocateInfo allocateInfo{};
@@ -1377,54 +1257,256 @@ void VulkanContext::initVulkan() {
 	pickPhysicalDevice();
 	createLogicalDevice();
 	initAllocator();
+	geometry.init(this);
 	createSwapChain();
 	createImageViews();
 	createRenderPass();
 	createGlobalDescriptorSetLayout();
-	createMaterialDescriptorSetLayout(*this);
+	materialTable.init(this);
 	createMeshDescriptorSetLayout(*this);
 	createUIDescriptorSetLayout(*this);
+	pipelines.init(this);
 	createUIPipeline(*this);
 	createWireframePipeline();
 	createCommandPools();
+	// One chunk slot per core, the calling thread included
+	secondaries.init(this, defaultWorkerCount() + 1);
+	uploads.init(this);
 	createDepthResources();
 	createFramebuffers();
 	createUniformBuffers();
 	createDescriptorAllocator();
-	createGlobalDescriptorSets();
+	createGlobalDescriptorSet();
+	createDrawBuffers();
+	if (!culling.onHost) {
+		depthPyramid.init(this);
+	}
+	createDepthPyramid();
 	createCommandBuffer();
 	createSyncObjects();
 	createUI(*this, &ui);
 }
 
-void VulkanContext::recordCommandBuffer(VkCommandBuffer commandBuffer,
-										uint32_t imageIndex) {
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = 0;
-	beginInfo.pInheritanceInfo = nullptr;
+// Dense ID of `value` among those seen this frame, or false once they no
+// longer fit in a key field of `bits`
+template <typename T>
+internal_func bool denseID(std::unordered_map<T, u32> &ids, T value, u32 bits,
+						   u32 *id) {
+	auto it = ids.find(value);
+	if (it == ids.end()) {
+		if (ids.size() >= (1ull << bits)) {
+			return false;
+		}
+		it = ids.insert({value, (u32)ids.size()}).first;
+	}
+	*id = it->second;
+	return true;
+}
 
-	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-		throw std::runtime_error("failed to begin recording command buffer!");
+std::vector<DrawBatch> VulkanContext::writeMeshDraws(uint32_t frame) {
+	std::unordered_map<VkPipeline, u32> pipelineIDs;
+	std::unordered_map<size_t, u32> materialIDs;
+	std::unordered_map<u64, u32> geometryIDs;
+	u32 indexTypeBit = 1u << (RENDER_KEY_GEOMETRY_BITS - 1);
+
+	renderQueue.clear();
+	for (auto kv : meshes) {
+		Mesh *mesh = kv.second;
+		// Wireframe draws share a pipeline whatever their material
+		VkPipeline pipeline = wireframeEnabled
+								  ? wireframePipeline
+								  : materials[mesh->materialId].pipeline;
+		size_t materialId = wireframeEnabled ? 0 : mesh->materialId;
+
+		u32 pipelineID, materialID, geometryID;
+		if (!denseID(pipelineIDs, pipeline, RENDER_KEY_PIPELINE_BITS,
+					 &pipelineID) ||
+			!denseID(materialIDs, materialId, RENDER_KEY_MATERIAL_BITS,
+					 &materialID) ||
+			!denseID(geometryIDs, mesh->modelID, RENDER_KEY_GEOMETRY_BITS - 1,
+					 &geometryID)) {
+			DEBUG_log("Meshes over the render key's capacity are skipped!\n");
+			continue;
+		}
+		if (mesh->indexType == VK_INDEX_TYPE_UINT32) {
+			geometryID |= indexTypeBit;
+		}
+
+		glm::vec3 position = glm::vec3(mesh->transform[3]);
+		f32 depth = glm::length(position - camera.position) / CAMERA_FAR_PLANE;
+		renderQueue.push(renderKey(pipelineID, materialID, geometryID, depth),
+						 mesh);
+	}
+	renderQueue.sort();
+
+	std::vector<Mesh *> &recorded = recordedInstances[frame];
+	recorded.clear();
+	std::vector<VkDrawIndexedIndirectCommand> &recordedDraw =
+		recordedDraws[frame];
+	recordedDraw.clear();
+	VkDrawIndexedIndirectCommand *commands =
+		(VkDrawIndexedIndirectCommand *)indirectBuffersMapped[frame];
+	CullDraw *cullDraws = (CullDraw *)culling.frames[frame].draws.mapped;
+	u32 *instanceDraws = (u32 *)culling.frames[frame].instanceDraws.mapped;
+	MeshInstance *instances = (MeshInstance *)meshInstanceBuffersMapped[frame];
+
+	// Items sharing pipeline, material and geometry are instances of one
+	// draw, nearest first. Draws sharing their pipeline and index type are
+	// batched into one call, instances pick their material from the table.
+	std::vector<DrawBatch> batches;
+	std::vector<RenderItem> &items = renderQueue.items;
+	u64 batchKey = 0;
+	u32 drawCount = 0;
+	u32 instanceCount = 0;
+	for (size_t i = 0; i < items.size();) {
+		u64 drawKey = items[i].key >> RENDER_KEY_GEOMETRY_SHIFT;
+		size_t end = i + 1;
+		while (end < items.size() &&
+			   items[end].key >> RENDER_KEY_GEOMETRY_SHIFT == drawKey) {
+			end++;
+		}
+
+		if (drawCount == MAX_MESH_DRAWS ||
+			instanceCount + (end - i) > MAX_MESH_INSTANCES) {
+			DEBUG_log("Mesh draws over MAX_MESH_DRAWS or MAX_MESH_INSTANCES "
+					  "are skipped!\n");
+			break;
+		}
+
+		Mesh *first = items[i].mesh;
+		u64 key = (items[i].key >> RENDER_KEY_PIPELINE_SHIFT) << 1 |
+				  (first->indexType == VK_INDEX_TYPE_UINT32);
+		if (batches.empty() || key != batchKey) {
+			DrawBatch batch{};
+			if (wireframeEnabled) {
+				batch.pipeline = wireframePipeline;
+				batch.pipelineLayout = wireframePipelineLayout;
+				batch.materialSet = VK_NULL_HANDLE;
+			} else {
+				Material &material = materials[first->materialId];
+				batch.pipeline = material.pipeline;
+				batch.pipelineLayout = material.pipelineLayout;
+				batch.materialSet = materialTable.descriptorSet;
+			}
+			batch.indexType = first->indexType;
+			batch.firstDraw = drawCount;
+			batch.index = (u32)batches.size();
+			batches.push_back(batch);
+			batchKey = key;
+		}
+
+		// NOTE: The group shares its geometry, any mesh of it will do
+		VkDrawIndexedIndirectCommand &command = commands[drawCount];
+		command.indexCount = (u32)first->indexCount;
+		command.instanceCount = (u32)(end - i);
+		command.firstIndex = first->firstIndex;
+		command.vertexOffset = first->vertexOffset;
+		command.firstInstance = instanceCount;
+		recordedDraw.push_back(command);
+
+		CullDraw &cullDraw = cullDraws[drawCount];
+		cullDraw.sphere = first->bounds;
+		cullDraw.batch = batches.back().index;
+		cullDraw.firstOutput = batches.back().firstDraw;
+
+		// NOTE: Meshes keep their material, writeMeshInstances leaves it be
+		for (; i < end; i++) {
+			recorded.push_back(items[i].mesh);
+			instances[instanceCount].material =
+				wireframeEnabled ? 0
+								 : materials[items[i].mesh->materialId].index;
+			instanceDraws[instanceCount] = drawCount;
+			instanceCount++;
+		}
+		drawCount++;
+		batches.back().drawCount++;
 	}
 
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = renderPass;
-	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-	renderPassInfo.renderArea.offset = {0, 0};
-	renderPassInfo.renderArea.extent = swapChainExtent;
-	std::array<VkClearValue, 2> clearValues{};
+	writeMeshInstances(frame);
+	return batches;
+}
 
-	clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-	clearValues[1].depthStencil = {1.0f, 0};
+void VulkanContext::writeMeshInstances(uint32_t frame) {
+	MeshInstance *instances = (MeshInstance *)meshInstanceBuffersMapped[frame];
+	const std::vector<Mesh *> &recorded = recordedInstances[frame];
+	if (culling.onHost) {
+		hostBounds.resize((u32)recorded.size());
+	}
+	for (size_t i = 0; i < recorded.size(); i++) {
+		glm::mat4 model = recorded[i]->transform * recorded[i]->dequantize;
+		instances[i].model = model;
+
+		if (culling.onHost) {
+			// The box around the transformed bounding sphere
+			glm::vec4 sphere = recorded[i]->bounds;
+			glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1));
+			f32 scale = std::max({glm::length(glm::vec3(model[0])),
+								  glm::length(glm::vec3(model[1])),
+								  glm::length(glm::vec3(model[2]))});
+			glm::vec3 min = center - sphere.w * scale;
+			glm::vec3 max = center + sphere.w * scale;
+			hostBounds.set((u32)i, &min[0], &max[0]);
+		}
+	}
+}
 
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
+// Writes what the culling pass would have from the frame's instance bounds,
+// see GpuCulling
+void VulkanContext::cullOnHost(uint32_t frame) {
+	hostVisible.resize(hostBounds.count);
+	u32 visibleCount = cullBoxes(frustum, hostBounds, hostVisible.data());
+
+	GpuCulling::CullFrame &cullFrame = culling.frames[frame];
+	memcpy(cullFrame.visible.mapped, hostVisible.data(),
+		   visibleCount * sizeof(u32));
+
+	// NOTE: A draw's instances are consecutive and the visible list is in
+	// order, so its visible instances are a run of the list
+	VkDrawIndexedIndirectCommand *output =
+		(VkDrawIndexedIndirectCommand *)cullFrame.output.mapped;
+	const std::vector<VkDrawIndexedIndirectCommand> &draws =
+		recordedDraws[frame];
+	u32 next = 0;
+	for (size_t i = 0; i < draws.size(); i++) {
+		VkDrawIndexedIndirectCommand command = draws[i];
+		u32 end = command.firstInstance + command.instanceCount;
+		command.firstInstance = next;
+		while (next < visibleCount && hostVisible[next] < end) {
+			next++;
+		}
+		command.instanceCount = next - command.firstInstance;
+		output[i] = command;
+	}
+}
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-						 VK_SUBPASS_CONTENTS_INLINE);
+// Draws the culling pass' output, see GpuCulling
+void VulkanContext::recordIndirectDraws(VkCommandBuffer commandBuffer,
+										const DrawBatch &batch) {
+	GpuCulling::CullFrame &cullFrame = culling.frames[currentFrame];
+	VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+	VkDeviceSize offset = batch.firstDraw * stride;
+	if (culling.drawIndirectCount) {
+		VkDeviceSize countOffset = (MAX_MESH_DRAWS + batch.index) * sizeof(u32);
+		vkCmdDrawIndexedIndirectCount(commandBuffer, cullFrame.output.buffer,
+									  offset, cullFrame.counts.buffer,
+									  countOffset, batch.drawCount,
+									  (u32)stride);
+		return;
+	}
+
+	if (multiDrawIndirect) {
+		vkCmdDrawIndexedIndirect(commandBuffer, cullFrame.output.buffer,
+								 offset, batch.drawCount, (u32)stride);
+		return;
+	}
+
+	for (u32 i = 0; i < batch.drawCount; i++) {
+		vkCmdDrawIndexedIndirect(commandBuffer, cullFrame.output.buffer,
+								 offset + i * stride, 1, (u32)stride);
+	}
+}
 
+void VulkanContext::recordViewport(VkCommandBuffer commandBuffer) {
 	VkViewport viewport{};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
@@ -1438,79 +1520,163 @@ void VulkanContext::recordCommandBuffer(VkCommandBuffer commandBuffer,
 	scissor.offset = {0, 0};
 	scissor.extent = swapChainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
 
-	if (raycasterCtx) {
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-						  raycasterCtx->pipeline);
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-								raycasterCtx->pipelineLayout, 0, 1,
-								&raycasterCtx->descriptorSets[currentFrame], 0,
-								nullptr);
-
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &raycasterCtx->vertexBuffer,
-							   offsets);
-		vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+void VulkanContext::recordRaycaster(VkCommandBuffer commandBuffer) {
+	if (!raycasterCtx) {
+		return;
 	}
 
-	for (auto kv : meshes) {
-		Mesh *mesh = kv.second;
-		VkBuffer vertexBuffers[] = {mesh->vertexBuffer};
-		VkDeviceSize offsets[] = {0};
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+					  raycasterCtx->pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+							raycasterCtx->pipelineLayout, 0, 1,
+							&raycasterCtx->descriptorSet, 1,
+							&raycasterCtx->uniformOffset);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+							raycasterCtx->pipelineLayout, 1, 1,
+							&materialTable.descriptorSet, 0, nullptr);
 
-		if (wireframeEnabled) {
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-							  wireframePipeline);
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &raycasterCtx->vertexBuffer,
+						   offsets);
+	vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+}
 
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, mesh->indexBuffer, 0,
-								 VK_INDEX_TYPE_UINT32);
+// Worker threads. Binds everything the batches use, a secondary command
+// buffer inherits no state.
+void VulkanContext::recordMeshBatches(VkCommandBuffer commandBuffer,
+									  const DrawBatch *batches,
+									  size_t batchCount) {
+	if (batchCount == 0) {
+		return;
+	}
 
-			vkCmdBindDescriptorSets(
-				commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				wireframePipelineLayout, 0, 1,
-				&globalDescriptorSets[currentFrame], 0, nullptr);
-			vkCmdBindDescriptorSets(
-				commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				wireframePipelineLayout, 1, 1,
-				&mesh->uniformDescriptorSets[currentFrame], 0, nullptr);
-		} else {
-			Material material = materials[mesh->materialId];
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-							  material.pipeline);
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &geometry.vertexBuffer,
+						   offsets);
 
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, mesh->indexBuffer, 0,
-								 VK_INDEX_TYPE_UINT32);
+	// NOTE: Batches come out of the sorted queue, so walking them only
+	// rebinds the state that changed
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+	VkDescriptorSet boundMaterialSet = VK_NULL_HANDLE;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+	for (size_t i = 0; i < batchCount; i++) {
+		const DrawBatch &batch = batches[i];
+		if (batch.pipeline != boundPipeline) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+							  batch.pipeline);
+			boundPipeline = batch.pipeline;
+		}
 
+		// Wireframe layouts have no material set, instances come right after
+		// the global set
+		if (batch.pipelineLayout != boundLayout) {
+			u32 instanceSet = batch.materialSet != VK_NULL_HANDLE ? 2 : 1;
 			vkCmdBindDescriptorSets(
 				commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				material.pipelineLayout, 0, 1,
-				&globalDescriptorSets[currentFrame], 0, nullptr);
+				batch.pipelineLayout, 0, 1, &globalDescriptorSet, 1,
+				&globalUniformOffset);
 			vkCmdBindDescriptorSets(
 				commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				material.pipelineLayout, 1, 1,
-				&material.descriptorSets[currentFrame], 0, nullptr);
+				batch.pipelineLayout, instanceSet, 1,
+				&meshDescriptorSets[currentFrame], 0, nullptr);
+			boundLayout = batch.pipelineLayout;
+			boundMaterialSet = VK_NULL_HANDLE;
+		}
+
+		if (batch.materialSet != VK_NULL_HANDLE &&
+			batch.materialSet != boundMaterialSet) {
 			vkCmdBindDescriptorSets(
 				commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				material.pipelineLayout, 2, 1,
-				&mesh->uniformDescriptorSets[currentFrame], 0, nullptr);
+				batch.pipelineLayout, 1, 1, &batch.materialSet, 0, nullptr);
+			boundMaterialSet = batch.materialSet;
 		}
-		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh->indexCount),
-						 1, 0, 0, 0);
+
+		if (batch.indexType != boundIndexType) {
+			vkCmdBindIndexBuffer(commandBuffer, geometry.indexBuffer, 0,
+								 batch.indexType);
+			boundIndexType = batch.indexType;
+		}
+		recordIndirectDraws(commandBuffer, batch);
+	}
+}
+
+void VulkanContext::recordCommandBuffer(VkCommandBuffer commandBuffer,
+										uint32_t imageIndex) {
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = 0;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent = swapChainExtent;
+	std::array<VkClearValue, 2> clearValues{};
+
+	clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+	clearValues[1].depthStencil = {1.0f, 0};
+
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	std::vector<DrawBatch> batches = writeMeshDraws(currentFrame);
+	// NOTE: Recorded here, it culls again every time the buffer is submitted
+	if (!batches.empty() && !culling.onHost) {
+		const DrawBatch &last = batches.back();
+		culling.record(commandBuffer, currentFrame,
+					   last.firstDraw + last.drawCount,
+					   (u32)recordedInstances[currentFrame].size());
 	}
 
+	// NOTE: The forward subpass is recorded by several threads at once
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+						 VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	u32 chunkCount = std::clamp((u32)(batches.size() / MIN_BATCHES_PER_CHUNK),
+								1u, secondaries.chunkSlots());
+	std::vector<VkCommandBuffer> chunks = secondaries.record(
+		currentFrame, swapChainFramebuffers[imageIndex], 0, chunkCount,
+		[&](VkCommandBuffer chunkBuffer, u32 chunk) {
+			recordViewport(chunkBuffer);
+			// The voxel world's depth has to come first
+			if (chunk == 0) {
+				recordRaycaster(chunkBuffer);
+			}
+
+			size_t begin = batches.size() * chunk / chunkCount;
+			size_t end = batches.size() * (chunk + 1) / chunkCount;
+			recordMeshBatches(chunkBuffer, batches.data() + begin,
+							  end - begin);
+		});
+	vkCmdExecuteCommands(commandBuffer, (u32)chunks.size(), chunks.data());
+
 	// UI Subpass
 	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+	recordViewport(commandBuffer);
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
 					  uiPipeline);
 	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
 							uiPipelineLayout, 0, 1,
 							&ui.descriptorSets[currentFrame], 0, nullptr);
-	vkCmdDraw(commandBuffer, ui.quadsWritten * 6, 1, 0, 0);
+	// NOTE: Its vertex count changes every frame, see drawFrame
+	vkCmdDrawIndirect(commandBuffer, indirectBuffers[currentFrame],
+					  UI_DRAW_OFFSET, 1, sizeof(VkDrawIndirectCommand));
 
 	vkCmdEndRenderPass(commandBuffer);
 
+	// For the next frame's culling
+	if (!culling.onHost) {
+		depthPyramid.record(commandBuffer);
+	}
+
 	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
 		throw std::runtime_error("failed to record command buffer!");
 	}
@@ -1533,6 +1699,8 @@ void VulkanContext::recreateSwapChain() {
 	createImageViews();
 	createDepthResources();
 	createFramebuffers();
+	createDepthPyramid();
+	sceneVersion++;
 }
 
 void VulkanContext::updateUniformBuffer(uint32_t currentImage) {
@@ -1550,22 +1718,32 @@ void VulkanContext::updateUniformBuffer(uint32_t currentImage) {
 		glm::radians(45.0f),								   // FOV
 		swapChainExtent.width / (float)swapChainExtent.height, // Aspect ratio
 		0.1f,												   // Near clip
-		100.0f);											   // Far clip
+		CAMERA_FAR_PLANE);									   // Far clip
 	proj[1][1] *= -1;
 
 	ubo.camera = proj * scaleFix * view;
 	ubo.cameraPos = camera.position;
+	ubo.previousCamera = previousCamera;
+	previousCamera = ubo.camera;
+
+	// Gribb-Hartmann, from the rows of the camera matrix. NOTE: w + z for the
+	// near plane holds for either depth range, only looser with 0 to 1.
+	glm::mat4 rows = glm::transpose(ubo.camera);
+	glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0],
+						   rows[3] + rows[1], rows[3] - rows[1],
+						   rows[3] + rows[2], rows[3] - rows[2]};
+	for (u32 i = 0; i < 6; i++) {
+		for (u32 c = 0; c < 4; c++) {
+			frustum.planes[i][c] = planes[i][c];
+		}
+	}
 
-	memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
-
-	// Per mesh uniform
-	for (auto kv : meshes) {
-		Mesh *mesh = kv.second;
+	// NOTE: Pushed first, its offset is the same every time this frame is
+	// written
+	globalUniformOffset = uniforms.push(ubo);
 
-		mesh->updateUniformBuffer(currentImage);
-	}
 	if (raycasterCtx != nullptr) {
-		raycasterCtx->updateUniform(currentImage);
+		raycasterCtx->updateUniform();
 	}
 }
 
@@ -1588,24 +1766,58 @@ void VulkanContext::drawFrame() {
 	// Only reset if we are submitting work, could deadlock otherwise
 	vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
-	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
-
+	// Before recording, which binds the offsets they were pushed at
+	uniforms.beginFrame(currentFrame);
 	updateUniformBuffer(currentFrame);
 
+	// Static scenes reuse what was recorded for this frame, only their
+	// per-frame data is rewritten
+	if (recordedVersions[currentFrame] != sceneVersion ||
+		recordedImages[currentFrame] != imageIndex) {
+		vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+		secondaries.beginFrame(currentFrame);
+		recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+		recordedVersions[currentFrame] = sceneVersion;
+		recordedImages[currentFrame] = imageIndex;
+	} else {
+		writeMeshInstances(currentFrame);
+	}
+
+	VkDrawIndirectCommand uiDraw{};
+	uiDraw.vertexCount = ui.quadsWritten * 6;
+	uiDraw.instanceCount = 1;
+	memcpy((u8 *)indirectBuffersMapped[currentFrame] + UI_DRAW_OFFSET, &uiDraw,
+		   sizeof(uiDraw));
+
+	if (culling.onHost) {
+		cullOnHost(currentFrame);
+	}
+
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
-	VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+	// NOTE: Everything handed over so far has already completed, waiting on
+	// it only makes the uploads visible to this frame
+	VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame],
+									uploads.timeline};
 	VkPipelineStageFlags waitStages[] = {
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-	submitInfo.waitSemaphoreCount = 1;
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT};
+	uint64_t waitValues[] = {0, uploads.completedValue()};
+	submitInfo.waitSemaphoreCount = 2;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = 2;
+	timelineInfo.pWaitSemaphoreValues = waitValues;
+	submitInfo.pNext = &timelineInfo;
+
 	VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
@@ -1653,6 +1865,9 @@ bool VulkanContext::render() {
 }
 
 void VulkanContext::cleanupSwapChain() {
+	if (!culling.onHost) {
+		depthPyramid.destroy();
+	}
 	vkDestroyImageView(device, depthImageView, nullptr);
 	vmaDestroyImage(allocator, depthImage, depthImageAllocation);
 
@@ -1671,14 +1886,12 @@ void VulkanContext::cleanup() {
 	cleanupSwapChain();
 
 	vkDestroyDescriptorSetLayout(device, globalDescriptorSetLayout, nullptr);
-	vkDestroyDescriptorSetLayout(device, materialDescriptorSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(device, meshDescriptorSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(device, uiDescriptorSetLayout, nullptr);
 	delete this->raycasterCtx;
 
 	for (const auto &kv : meshes) {
 		Mesh *mesh = kv.second;
-		mesh->cleanup(*this);
 		delete mesh;
 	}
 
@@ -1691,14 +1904,20 @@ void VulkanContext::cleanup() {
 		material.cleanup(*this);
 	}
 
-	vkDestroyPipeline(device, uiPipeline, nullptr);
-	vkDestroyPipelineLayout(device, uiPipelineLayout, nullptr);
-	vkDestroyPipeline(device, wireframePipeline, nullptr);
-	vkDestroyPipelineLayout(device, wireframePipelineLayout, nullptr);
+	pipelines.release(uiPipeline);
+	pipelines.release(wireframePipeline);
+	culling.cleanup();
+	if (!culling.onHost) {
+		depthPyramid.cleanup();
+	}
+	uniforms.cleanup();
+	materialTable.cleanup();
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		vmaDestroyBuffer(allocator, uniformBuffers[i],
-						 uniformBuffersAllocations[i]);
+		vmaDestroyBuffer(allocator, meshInstanceBuffers[i],
+						 meshInstanceBuffersAllocations[i]);
+		vmaDestroyBuffer(allocator, indirectBuffers[i],
+						 indirectBuffersAllocations[i]);
 	}
 
 	vkDestroyRenderPass(device, renderPass, nullptr);
@@ -1710,7 +1929,10 @@ void VulkanContext::cleanup() {
 	}
 
 	vkDestroyCommandPool(device, drawCommandPool, nullptr);
-	vkDestroyCommandPool(device, transientCommandPool, nullptr);
+	secondaries.cleanup();
+	uploads.cleanup();
+	pipelines.cleanup();
+	geometry.cleanup();
 
 	vmaDestroyAllocator(allocator);
 	vkDestroyDevice(device, nullptr);
@@ -2,11 +2,21 @@
 
 #include <plover/plover.h>
 
+#include "DepthPyramid.h"
 #include "DescriptorAllocator.h"
+#include "CpuCulling.h"
+#include "GeometryArena.h"
+#include "GpuCulling.h"
 #include "Material.h"
+#include "MaterialTable.h"
 #include "Mesh.h"
+#include "PipelineCache.h"
+#include "RenderQueue.h"
+#include "SecondaryRecorder.h"
 #include "Texture.h"
 #include "UI.h"
+#include "UniformArena.h"
+#include "UploadManager.h"
 #include "raycaster.h"
 #include "ttfRenderer.h"
 
@@ -22,23 +32,18 @@ const int MAX_FRAMES_IN_FLIGHT = 3;
 
 const std::string TEXTURE_PATH = "../resources/textures/viking_room.png";
 
-const std::vector<Vertex> quadVertices = {
-	{{-1.0, -1.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0, 0.0}, {0.0, 0.0}},
-	{{-1.0, 1.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0, 0.0}, {0.0, 1.0}},
-	{{0.125, 1.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0, 0.0}, {1.0, 1.0}},
-	{{0.125, -1.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0, 0.0}, {1.0, 0.0}},
-};
-
-const std::vector<u32> quadIndices = {0, 1, 2, 0, 2, 3};
-
 struct GlobalUniform {
 	alignas(16) glm::mat4 camera;
 	alignas(16) glm::vec3 cameraPos;
+	// The last frame's, which the depth pyramid was built with
+	alignas(16) glm::mat4 previousCamera;
 };
 
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	// A transfer only family when there is one, the graphics one otherwise
+	std::optional<uint32_t> transferFamily;
 
 	bool isComplete() {
 		return graphicsFamily.has_value() && presentFamily.has_value();
@@ -71,6 +76,39 @@ struct PipelineCreateInfo {
 	VkVertexInputAttributeDescription *pAttributeDescriptions;
 };
 
+// Indirect draws and their instances recorded per frame, see
+// VulkanContext::writeMeshDraws
+#define MAX_MESH_DRAWS 16384
+#define MAX_MESH_INSTANCES 65536
+
+#define CAMERA_FAR_PLANE 100.0f
+
+// Fewer batches than this are recorded on a single thread
+#define MIN_BATCHES_PER_CHUNK 32
+
+// The UI's VkDrawIndirectCommand sits after the mesh draws' commands
+#define UI_DRAW_OFFSET (MAX_MESH_DRAWS * sizeof(VkDrawIndexedIndirectCommand))
+
+// Consecutive indirect draws sharing their state, issued with one call
+struct DrawBatch {
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSet materialSet; // The material table's, null for wireframe
+	VkIndexType indexType;
+	u32 firstDraw;
+	u32 drawCount;
+	u32 index; // Among the frame's batches
+};
+
+struct ComputePipelineCreateInfo {
+	const char *shaderPath;
+
+	u32 descriptorSetLayoutCount;
+	VkDescriptorSetLayout *pDescriptorSetLayouts;
+
+	u32 pushConstantSize; // Compute stage only, 0 for none
+};
+
 struct CreateBufferInfo {
 	VkDeviceSize size;
 	VkBufferUsageFlags usage;
@@ -83,6 +121,7 @@ struct CreateImageInfo {
 	u32 height;
     u32 depth = 1;
 	u32 layers;
+	u32 mipLevels = 1;
 	VkFormat format;
 	VkImageTiling tiling;
 	VkImageUsageFlags usage;
@@ -96,6 +135,8 @@ struct CreateImageViewInfo {
 	VkImageAspectFlags aspectFlags;
 	VkImageViewType viewType;
 	u32 layers;
+	u32 mipLevels = 1;
+	u32 baseMipLevel = 0;
 };
 
 struct VulkanContext {
@@ -126,8 +167,10 @@ struct VulkanContext {
 	VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
 	DescriptorAllocator descriptorAllocator;
 
+	QueueFamilyIndices queueFamilies;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VkQueue transferQueue;
 
 	VkSurfaceKHR surface;
 
@@ -141,14 +184,16 @@ struct VulkanContext {
 	VkRenderPass renderPass;
 
 	VkCommandPool drawCommandPool;
-	VkCommandPool transientCommandPool;
+	SecondaryRecorder secondaries;
+	UploadManager uploads;
+	PipelineCache pipelines;
 
 	VkDescriptorSetLayout globalDescriptorSetLayout;
-	VkDescriptorSetLayout materialDescriptorSetLayout;
 	VkDescriptorSetLayout meshDescriptorSetLayout;
 	VkDescriptorSetLayout uiDescriptorSetLayout;
 
-	std::vector<VkDescriptorSet> globalDescriptorSets;
+	// Reads the global uniform at globalUniformOffset
+	VkDescriptorSet globalDescriptorSet;
 
 	UIContext ui;
 	RaycasterContext *raycasterCtx;
@@ -164,10 +209,46 @@ struct VulkanContext {
 
 	std::unordered_map<size_t, Mesh *> meshes;
 	std::unordered_map<size_t, Material> materials;
-
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VmaAllocation> uniformBuffersAllocations;
-	std::vector<void *> uniformBuffersMapped;
+	// Textures and materials of every mesh and of the raycaster
+	MaterialTable materialTable;
+
+	UniformArena uniforms;
+	u32 globalUniformOffset; // From updateUniformBuffer
+
+	GeometryArena geometry;
+	// Otherwise batches are drawn one indirect command at a time
+	bool multiDrawIndirect;
+
+	// Per frame, rewritten while recording it. A draw's instances are
+	// consecutive, starting at its firstInstance.
+	std::vector<VkBuffer> meshInstanceBuffers;
+	std::vector<VmaAllocation> meshInstanceBuffersAllocations;
+	std::vector<void *> meshInstanceBuffersMapped;
+	std::vector<VkBuffer> indirectBuffers;
+	std::vector<VmaAllocation> indirectBuffersAllocations;
+	std::vector<void *> indirectBuffersMapped;
+	std::vector<VkDescriptorSet> meshDescriptorSets;
+	RenderQueue renderQueue;
+	// Frustum and occlusion culls the mesh instances before they are drawn
+	GpuCulling culling;
+	DepthPyramid depthPyramid; // Not with culling.onHost
+
+	// Bumped by anything changing what recordCommandBuffer records: the mesh
+	// set, materials, the render mode and the swap chain. Command buffers are
+	// only recorded again when it changes, as everything else they draw with
+	// is read from buffers rewritten every frame.
+	u64 sceneVersion = 0;
+	// Per frame, what its command buffer was last recorded for
+	std::vector<u64> recordedVersions;
+	std::vector<u32> recordedImages;
+	std::vector<std::vector<Mesh *>> recordedInstances;
+	std::vector<std::vector<VkDrawIndexedIndirectCommand>> recordedDraws;
+
+	// Culling on the host, see cullOnHost
+	Frustum frustum; // The camera's, from updateUniformBuffer
+	glm::mat4 previousCamera = glm::mat4(1);
+	CullBounds hostBounds;
+	std::vector<u32> hostVisible;
 
 	Texture texture;
 
@@ -249,9 +330,6 @@ struct VulkanContext {
 
 	VkShaderModule createShaderModule(const std::vector<char> &code);
 
-	void createGraphicsPipeline(PipelineCreateInfo info, VkPipeline &pipeline,
-								VkPipelineLayout &pipelineLayout);
-
 	void createWireframeDescriptorSetLayout();
 	void createWireframePipeline();
 
@@ -261,14 +339,10 @@ struct VulkanContext {
 						   VkCommandPool &commandPool);
 	void createCommandPools();
 
-	void transitionImageLayout(VkImage image, VkFormat format,
-							   VkImageLayout oldLayout, VkImageLayout newLayout,
-							   u32 layers);
-
-	void copyBufferToImage(VkBuffer buffer, VkImage image, u32 width,
-						   u32 height, u32 imageSize, u32 layers);
-	void copyBufferToImage(VkBuffer buffer, VkImage image, u32 width,
-						   u32 height, u32 depth, u32 imageSize, u32 layers);
+	void recordImageLayoutTransition(VkCommandBuffer commandBuffer,
+									 VkImage image, VkImageLayout oldLayout,
+									 VkImageLayout newLayout, u32 layers,
+									 u32 mipLevels = 1);
 
 	VkFormat findSupportedFormats(const std::vector<VkFormat> &candidates,
 								  VkImageTiling tiling,
@@ -277,21 +351,36 @@ struct VulkanContext {
 	VkFormat findDepthFormat();
 	void createDepthResources();
 
-	VkCommandBuffer beginSingleTimeCommands();
-	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+	// Copies host data to a device local buffer through the upload manager,
+	// then waits for the copy to complete
+	void uploadBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer);
 
 	void createUniformBuffers();
 
 	void createDescriptorAllocator();
 
-	void createGlobalDescriptorSets();
+	void createGlobalDescriptorSet();
+
+	void createDrawBuffers();
+	void createDepthPyramid();
 
 	void createCommandBuffer();
 
 	void createSyncObjects();
 
+	// Sorts the meshes through the render queue, then writes the frame's
+	// instances and one indirect command per pipeline, material and model,
+	// grouped into batches that share their state
+	std::vector<DrawBatch> writeMeshDraws(uint32_t frame);
+	// Rewrites the instances' transforms in the order they were recorded
+	void writeMeshInstances(uint32_t frame);
+	void cullOnHost(uint32_t frame);
+	void recordIndirectDraws(VkCommandBuffer commandBuffer,
+							 const DrawBatch &batch);
+	void recordViewport(VkCommandBuffer commandBuffer);
+	void recordRaycaster(VkCommandBuffer commandBuffer);
+	void recordMeshBatches(VkCommandBuffer commandBuffer,
+						   const DrawBatch *batches, size_t batchCount);
 	void recordCommandBuffer(VkCommandBuffer currentCommandBuffer,
 							 uint32_t imageIndex);
 
@@ -10,10 +10,13 @@
 #include <cstddef>
 #include <cstdlib>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #define LINUX_GAME_SO "../libPloverRaycaster.so"
 #define GAME_UPDATE_RENDER_FUNC "gameUpdateAndRender"
@@ -39,6 +42,46 @@ void readFile(const char *path, u8 **buffer, u32 *bufferSize) {
 	fclose(fp);
 }
 
+bool mapFile(const char *path, MappedFile *file) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+
+	struct stat fileStat = {};
+	if (fstat(fd, &fileStat) == -1 || fileStat.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// NOTE: The mapping keeps its own reference to the file
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	file->data = (const u8 *)data;
+	file->size = fileStat.st_size;
+	file->handle = nullptr;
+	return true;
+}
+
+void unmapFile(MappedFile *file) {
+	if (file->data != nullptr) {
+		munmap((void *)file->data, file->size);
+	}
+	*file = {};
+}
+
+void prefetchMappedRange(const MappedFile *file, u64 offset, u64 size) {
+	// madvise wants a page aligned start
+	u64 pageSize = sysconf(_SC_PAGESIZE);
+	u64 start = offset / pageSize * pageSize;
+	madvise((void *)(file->data + start), size + (offset - start),
+			MADV_WILLNEED);
+}
+
 void DEBUG_log(const char *f, ...) {
 	va_list args;
 	va_start(args, f);
@@ -112,6 +155,7 @@ internal_func Handles linux_createHandles() {
 	handles.pushRenderCommand = pushRenderCommand;
 	handles.hasRenderMessage = hasRenderMessage;
 	handles.popRenderMessage = popRenderMessage;
+	handles.getUploadStats = getUploadStats;
 	handles.UI_Clear = UI_Clear;
 	handles.UI_Rect = UI_Rect;
 	handles.UI_Text = UI_Text;
@@ -121,6 +121,10 @@ RenderMessage popRenderMessage() {
 	return ctx.renderer.messageQueue.pop();
 }
 
+UploadStats getUploadStats() {
+	return ctx.renderer.context->uploads.stats();
+}
+
 void UI_Clear() {
 	ctx.renderer.UI_Clear();
 }
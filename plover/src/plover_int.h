@@ -27,6 +27,11 @@ struct linux_GameCode {
 extern PloverContext ctx;
 
 void readFile(const char *path, u8 **buffer, u32 *bufferSize);
+// Maps a whole file read-only. Pages are read in on first touch.
+bool mapFile(const char *path, MappedFile *file);
+void unmapFile(MappedFile *file);
+// Hints that a range of a mapped file is about to be read
+void prefetchMappedRange(const MappedFile *file, u64 offset, u64 size);
 void DEBUG_log(const char *f, ...);
 
 // Input callbacks
@@ -35,6 +40,7 @@ InputMessage getInputMessage();
 void pushRenderCommand(RenderCommand inMsg);
 bool hasRenderMessage();
 RenderMessage popRenderMessage();
+UploadStats getUploadStats();
 void mouseCallback(GLFWwindow* window, double position_x, double position_y);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void clickCallback(GLFWwindow* window, int button, int action, int mods);
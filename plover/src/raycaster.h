@@ -8,33 +8,29 @@
 #include "Texture.h"
 #include "glm/fwd.hpp"
 
-const int MAX_TEXTURES = 3;
-
 struct RaycasterContext {
   public:
 	// Raycaster information
 	Texture lvlTex;
+	Texture blockTex; // Voxel::block of each voxel, G8
 	// std::vector<Texture *> textures;
 
 	VulkanContext *context;
-	std::vector<VkDescriptorSet> descriptorSets;
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VmaAllocation> uniformBufferAllocations;
-	std::vector<void *> uniformBuffersMapped;
+	VkDescriptorSet descriptorSet;
+	u32 uniformOffset = 0; // In context->uniforms, from updateUniform
 	VkBuffer vertexBuffer;
 	VmaAllocation vertexBufferAlloc;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
 
-	void updateUniform(uint32_t currentImage);
-	RaycasterContext(Texture &map, VulkanContext *context);
+	void updateUniform();
+	RaycasterContext(Texture &map, Texture &blocks, VulkanContext *context);
 	~RaycasterContext();
 
   private:
-	void createUniformBuffers();
 	void createVertexBuffer();
-	void createDescriptorSets();
+	void createDescriptorSet();
 	void createRaycasterPipeline();
 	void createDescriptorSetLayout();
 
@@ -50,6 +46,7 @@ struct RaycasterUniform {
 	alignas(4) float aspectRatio;
 	alignas(4) float minDistance;
 	alignas(4) float maxDistance;
+	alignas(4) u32 materialCount; // Blocks past it are drawn plain
 };
 
 struct RaycasterVertex {
@@ -20,6 +20,54 @@ void readFile(const char *path, u8 **buffer, u32 *bufferSize) {
 	CloseHandle(hFile);
 }
 
+bool mapFile(const char *path, MappedFile *file) {
+	HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+							   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(hFile);
+		return false;
+	}
+
+	HANDLE hMapping =
+		CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	// NOTE: The mapping keeps its own reference to the file
+	CloseHandle(hFile);
+	if (hMapping == NULL) {
+		return false;
+	}
+
+	void *data = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		CloseHandle(hMapping);
+		return false;
+	}
+
+	file->data = (const u8 *)data;
+	file->size = fileSize.QuadPart;
+	file->handle = hMapping;
+	return true;
+}
+
+void unmapFile(MappedFile *file) {
+	if (file->data != NULL) {
+		UnmapViewOfFile(file->data);
+		CloseHandle((HANDLE)file->handle);
+	}
+	*file = {};
+}
+
+void prefetchMappedRange(const MappedFile *file, u64 offset, u64 size) {
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)(file->data + offset);
+	range.NumberOfBytes = size;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
 void DEBUG_log(const char *f, ...) {
 	va_list args;
 	va_start(args, f);
@@ -114,6 +162,7 @@ internal_func Handles win32_createHandles() {
 	handles.pushRenderCommand = pushRenderCommand;
 	handles.hasRenderMessage = hasRenderMessage;
 	handles.popRenderMessage = popRenderMessage;
+	handles.getUploadStats = getUploadStats;
 	handles.UI_Clear = UI_Clear;
 	handles.UI_Rect = UI_Rect;
 	handles.UI_Text = UI_Text;
@@ -0,0 +1,35 @@
+// Generated by lapwing from the asset list. Do not edit.
+#pragma once
+
+#include <lapwing.h>
+
+constexpr u64 ASSET_RECT_OBJ = 0x7dc8ca26c19a6840ull; // models/rect.obj
+static_assert(ASSET_RECT_OBJ == hashAssetName("rect.obj"));
+constexpr u64 ASSET_MAP_VOX = 0xd4211d5d31e3bd96ull; // models/map.vox
+static_assert(ASSET_MAP_VOX == hashAssetName("map.vox"));
+constexpr u64 ASSET_FLOOR_PNG = 0xd9ff46a7f4532eb8ull; // textures/floor.png
+static_assert(ASSET_FLOOR_PNG == hashAssetName("floor.png"));
+constexpr u64 ASSET_NORMAL_JPG = 0x9f25ce907f6efcdbull; // textures/normal.jpg
+static_assert(ASSET_NORMAL_JPG == hashAssetName("normal.jpg"));
+constexpr u64 ASSET_SPHERE_PNG = 0xd3f0de03c9cbb03dull; // textures/sphere.png
+static_assert(ASSET_SPHERE_PNG == hashAssetName("sphere.png"));
+constexpr u64 ASSET_WALL_PNG = 0x2fd5ee5f32d4cc30ull; // textures/wall.png
+static_assert(ASSET_WALL_PNG == hashAssetName("wall.png"));
+constexpr u64 ASSET_STONES_COLOR_PNG = 0x2c861317787f9362ull; // textures/stones_color.png
+static_assert(ASSET_STONES_COLOR_PNG == hashAssetName("stones_color.png"));
+constexpr u64 ASSET_STONES_NRM_PNG = 0x7d49e44ddc4a5252ull; // textures/stones_nrm.png
+static_assert(ASSET_STONES_NRM_PNG == hashAssetName("stones_nrm.png"));
+constexpr u64 ASSET_ARTEFACT_OBJ = 0x589a3ae8eacd40d0ull; // models/artefact.obj
+static_assert(ASSET_ARTEFACT_OBJ == hashAssetName("artefact.obj"));
+
+constexpr u64 KNOWN_ASSET_IDS[] = {
+	0x7dc8ca26c19a6840ull,
+	0xd4211d5d31e3bd96ull,
+	0xd9ff46a7f4532eb8ull,
+	0x9f25ce907f6efcdbull,
+	0xd3f0de03c9cbb03dull,
+	0x2fd5ee5f32d4cc30ull,
+	0x2c861317787f9362ull,
+	0x7d49e44ddc4a5252ull,
+	0x589a3ae8eacd40d0ull,
+};
@@ -1,7 +1,34 @@
 // vim:ft=glsl
 #version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (std140, binding = 0) uniform RaycasterUniform {
+    vec3 cameraPos;
+    vec3 cameraDir;
+    vec3 cameraUp;
+    vec3 cameraLeft;
+    float fov;
+    float aspectRatio;
+    float zNear;
+    float zFar;
+    uint materialCount;
+} uRay;
 
 layout (binding = 1) uniform sampler3D map;
+// Voxel::block of each voxel: material table index plus one, 0 if plain
+layout (binding = 2) uniform sampler3D blocks;
+
+// The material table, see MaterialTable.h
+struct Material {
+    uint texture;
+    uint normal;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer Materials {
+    Material materials[];
+} materials;
+layout (set = 1, binding = 1) uniform sampler textureSampler;
+layout (set = 1, binding = 2) uniform texture2D textures[];
 
 layout (location = 0) in RayInfo {
     vec3 position;
@@ -19,8 +46,25 @@ vec3 bounds = textureSize(map, 0).xzy;
 ivec3 mapPos = ivec3(iRay.position);
 vec3 deltaDist = 1 / abs(dir);
 
-void onHit(float dist, vec4 tile) {
+// Blocks are textured with their material, `side` is the axis of the face
+// hit. Voxels that aren't blocks, or whose material isn't in the table yet,
+// keep their color.
+vec4 blockColor(vec3 pos, vec4 tile, int side) {
+    uint block = uint(round(texelFetch(blocks, mapPos.xzy, 0).r * 255));
+    if (block == 0 || block > uRay.materialCount) {
+        return tile;
+    }
+    Material material = materials.materials[block - 1];
+    vec3 f = fract(pos);
+    vec2 uv = side == 0 ? f.zy : (side == 1 ? f.xz : f.xy);
+    vec4 color = texture(
+        sampler2D(textures[nonuniformEXT(material.texture)], textureSampler), uv);
+    return vec4(color.rgb, 1);
+}
+
+void onHit(float dist, vec4 tile, int side) {
     vec3 pos = iRay.position + dist * dir;
+    tile = blockColor(pos, tile, side);
     vec3 mins = min(ceil(pos) - pos, pos - floor(pos));
     float factor = 1 - (0.7) 
         * float(min(mins.x + mins.y, min(mins.x + mins.z, mins.y + mins.z)) < 0.02);
@@ -63,15 +107,18 @@ void main() {
 
     // Get offset from ray original position to model bounds
     float offset = iRay.zFar;
+    int side = 0;
     vec3 lambda = ((1 - gt0) * bounds - iRay.position) / dir;
     if (bounds_yz(iRay.position + lambda.x * dir)) {
         offset = min(lambda.x, offset);
     } 
-    if (bounds_xz(iRay.position + lambda.y * dir)) {
-        offset = min(lambda.y, offset);
+    if (bounds_xz(iRay.position + lambda.y * dir) && lambda.y < offset) {
+        offset = lambda.y;
+        side = 1;
     } 
-    if (bounds_xy(iRay.position + lambda.z * dir)) {
-        offset = min(lambda.z, offset);
+    if (bounds_xy(iRay.position + lambda.z * dir) && lambda.z < offset) {
+        offset = lambda.z;
+        side = 2;
     }
     offset = max(0, offset);
 
@@ -93,17 +140,20 @@ void main() {
         if (dist == sideDist.x) {
             sideDist.x += deltaDist.x;
             mapPos.x += tstep.x;
+            side = 0;
         } else if (dist == sideDist.z) {
             sideDist.z += deltaDist.z;
             mapPos.z += tstep.z;
+            side = 2;
         } else {
             sideDist.y += deltaDist.y;
             mapPos.y += tstep.y;
+            side = 1;
         }
         tile = texelFetch(map, mapPos.xzy, 0);
     }
     if (tile.a != 0) {
-        onHit(dist, tile);
+        onHit(dist, tile, side);
     } else {
         emptyColor();
     }
@@ -10,6 +10,7 @@ layout (std140, binding = 0) uniform RaycasterUniform {
     float aspectRatio;
     float zNear;
     float zFar;
+    uint materialCount;
 } uRay;
 
 layout (location = 0) in vec2 inPosition;
@@ -1,17 +1,28 @@
 #version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(set = 0, binding = 0) uniform GlobalUniform {
 	mat4 camera;
 	vec3 cameraPos;
 } global;
 
-layout(set = 1, binding = 0) uniform sampler2D texSampler;
-layout(set = 1, binding = 1) uniform sampler2D nrmSampler;
+// The material table, see MaterialTable.h
+struct Material {
+	uint texture;
+	uint normal;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Materials {
+	Material materials[];
+} materials;
+layout(set = 1, binding = 1) uniform sampler textureSampler;
+layout(set = 1, binding = 2) uniform texture2D textures[];
 
 layout(location = 0) in FragIn {
 	mat3 TBN;
 	vec2 texCoord;
 	vec3 fragPos;
+	flat uint material;
 } fragIn;
 
 layout(location = 0) out vec4 outColor;
@@ -21,12 +32,21 @@ float diffuseStrength = 0.7f;
 float specularStrength = 0.3f;
 vec3 lightDir = normalize(vec3(1, 1, -1));
 
+// NOTE: Draws of a batch share fragment subgroups, whatever their material
+vec4 sampleTexture(uint slot, vec2 uv)
+{
+	return texture(sampler2D(textures[nonuniformEXT(slot)], textureSampler), uv);
+}
+
 void main()
 {
-	vec4 nrmSample = texture(nrmSampler, fragIn.texCoord);
+	Material material = materials.materials[fragIn.material];
+	vec4 nrmSample = sampleTexture(material.normal, fragIn.texCoord);
 	float spec = nrmSample.a;
-	vec3 normal = nrmSample.rgb;
-	normal = normal * 2.0 - 1.0;
+	// NOTE: Opaque normal maps are packed as BC5, which only keeps x and y
+	vec3 normal;
+	normal.xy = nrmSample.rg * 2.0 - 1.0;
+	normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
 	normal = normalize(fragIn.TBN * normal);
 	float diffuseIntensity = max(dot(normal, lightDir), 0.f) * diffuseStrength;
 
@@ -36,5 +56,5 @@ void main()
 
 	float lightIntensity = (ambientIntensity + diffuseIntensity + specularIntensity);
 
-	outColor = vec4(lightIntensity * texture(texSampler, fragIn.texCoord).rgb, 1.0f);
+	outColor = vec4(lightIntensity * sampleTexture(material.texture, fragIn.texCoord).rgb, 1.0f);
 }
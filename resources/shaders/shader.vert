@@ -5,28 +5,57 @@ layout(set = 0, binding = 0) uniform GlobalUniform {
 	vec3 cameraPos;
 } global;
 
-layout(set = 2, binding = 0) uniform MeshUniform {
+// Same as Mesh.h's MeshInstance
+struct MeshInstance {
 	mat4 model;
-} mesh;
+	uint material;
+};
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec3 inTangent;
+// Every mesh sharing a model and material is an instance of the same draw,
+// gl_InstanceIndex starts at the draw's firstInstance and only counts the
+// visible ones
+layout(std430, set = 2, binding = 0) readonly buffer MeshInstances {
+	MeshInstance instances[];
+} instances;
+
+// Visible instances by draw, left by cull.comp
+layout(std430, set = 2, binding = 1) readonly buffer VisibleInstances {
+	uint indices[];
+} visible;
+
+// Quantized by lapwing: unorm position inside the mesh's bounding cube
+// (the instance's model undoes it), octahedral normal and tangent.
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inTangent;
 layout(location = 3) in vec2 inTexCoord;
 
 layout(location = 0) out FragIn {
 	mat3 TBN;
 	vec2 texCoord;
 	vec3 fragPos;
+	flat uint material;
 } fragIn;
 
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
 void main()
 {
-	gl_Position = global.camera * mesh.model * vec4(inPosition, 1.0);
-	vec3 T = normalize(vec3(mesh.model * vec4(inTangent, 0.0)));
-	vec3 N = normalize(vec3(mesh.model * vec4(inNormal, 0.0)));
+	MeshInstance instance = instances.instances[visible.indices[gl_InstanceIndex]];
+	mat4 model = instance.model;
+	vec4 position = vec4(inPosition.xyz, 1.0);
+	gl_Position = global.camera * model * position;
+	vec3 T = normalize(vec3(model * vec4(decodeOctahedral(inTangent), 0.0)));
+	vec3 N = normalize(vec3(model * vec4(decodeOctahedral(inNormal), 0.0)));
 	vec3 B = cross(N, T);
 	fragIn.TBN = mat3(T, B, N);
 	fragIn.texCoord = inTexCoord;
-	fragIn.fragPos = vec3(mesh.model * vec4(inPosition, 1.0));
+	fragIn.fragPos = vec3(model * position);
+	fragIn.material = instance.material;
 }
@@ -5,17 +5,29 @@ layout(set = 0, binding = 0) uniform GlobalUniform {
 	vec3 cameraPos;
 } global;
 
-layout(set = 1, binding = 0) uniform MeshUniform {
+// Same as shader.vert's
+struct MeshInstance {
 	mat4 model;
-} mesh;
+	uint material;
+};
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec3 inTangent;
+layout(std430, set = 1, binding = 0) readonly buffer MeshInstances {
+	MeshInstance instances[];
+} instances;
+
+// Visible instances by draw, left by cull.comp
+layout(std430, set = 1, binding = 1) readonly buffer VisibleInstances {
+	uint indices[];
+} visible;
+
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inTangent;
 layout(location = 3) in vec2 inTexCoord;
 
 void main()
 {
-	vec3 throwaway = inNormal + inTangent + vec3(inTexCoord, 1.0);
-	gl_Position = global.camera * mesh.model * vec4(inPosition, 1.0);
+	mat4 model = instances.instances[visible.indices[gl_InstanceIndex]].model;
+	vec2 throwaway = inNormal + inTangent + inTexCoord;
+	gl_Position = global.camera * model * vec4(inPosition.xyz, 1.0);
 }
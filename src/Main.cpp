@@ -44,8 +44,8 @@ internal_func void init(GameMemory *mem) {
 	handles.pushRenderCommand(
 		{.tag = CREATE_MATERIAL,
 		 .id = 0,
-		 .v = {.createMaterial = {.textureName = "stones_color.png",
-								  .normalName = "stones_nrm.png"}}});
+		 .v = {.createMaterial = {.textureID = assetID("stones_color.png"),
+								  .normalID = assetID("stones_nrm.png")}}});
 
 	// Set up object positions
 	state->loading = 10;
@@ -141,6 +141,10 @@ internal_func void drawUI(GameState *state) {
 	Vec4 color = Vec4(0.914, 0.831, 0.612, 1.0);
 	handles.UI_Text(color, UVec2(16, 26), "It's drawing! current FPS: %.2f",
 					1.0 / state->deltaTime);
+	UploadStats uploads = handles.getUploadStats();
+	handles.UI_Text(color, UVec2(16, 52), "Uploads queued: %u (%.1f MB)",
+					uploads.queuedUploads,
+					uploads.queuedBytes / (1024.0 * 1024.0));
 
 	// Draw frame
 	handles.UI_Rect(color, UVec2(10, 10), UVec2(1260, 10));
@@ -158,7 +162,7 @@ internal_func void onReceivedInput(RenderMessage msg, GameState &game) {
 					{.tag = CREATE_MESH,
 					 .id = (u32)i,
 					 .v = {.createMesh = {
-							   .name = "artefact.obj",
+							   .modelID = assetID("artefact.obj"),
 							   .materialID = msg.v.materialCreated.materialID,
 						   }}});
 			}